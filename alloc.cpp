@@ -0,0 +1,80 @@
+//==============================================================================
+// alloc.cpp	Count the heap allocations made by the C++ code
+//					part of Pi-Clock, see alloc.h
+//==============================================================================
+//
+// spaced with tab=4
+//
+// The replacements just count and pass the job on to malloc() and free().
+//
+//==============================================================================
+
+#include "alloc.h"
+#include <new>
+#include <atomic>
+#include <stdlib.h>
+
+static std::atomic<long> count{0};
+
+long allocations()
+{
+	return count.load(std::memory_order_relaxed);
+}
+
+static void* allocate(size_t size)
+{
+	count.fetch_add(1, std::memory_order_relaxed);
+	return malloc(size ? size : 1);
+}
+
+static void* allocate(size_t size, std::align_val_t align)
+{
+	count.fetch_add(1, std::memory_order_relaxed);
+	size_t a = size_t(align);
+	size = (size + a - 1)/a*a;				// aligned_alloc wants a multiple
+	return aligned_alloc(a, size ? size : a);
+}
+
+void* operator new(size_t size)
+{
+	void* p = allocate(size);
+	if(!p) throw std::bad_alloc();
+	return p;
+}
+void* operator new[](size_t size)
+{
+	void* p = allocate(size);
+	if(!p) throw std::bad_alloc();
+	return p;
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return allocate(size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return allocate(size);
+}
+void* operator new(size_t size, std::align_val_t align)
+{
+	void* p = allocate(size, align);
+	if(!p) throw std::bad_alloc();
+	return p;
+}
+void* operator new[](size_t size, std::align_val_t align)
+{
+	void* p = allocate(size, align);
+	if(!p) throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept							{ free(p); }
+void operator delete[](void* p) noexcept						{ free(p); }
+void operator delete(void* p, size_t) noexcept					{ free(p); }
+void operator delete[](void* p, size_t) noexcept				{ free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept	{ free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept	{ free(p); }
+void operator delete(void* p, std::align_val_t) noexcept		{ free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept		{ free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept	{ free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept	{ free(p); }
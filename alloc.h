@@ -0,0 +1,20 @@
+//==============================================================================
+// alloc.h		Count the heap allocations made by the C++ code
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// alloc.cpp replaces the global operator new so every std::string,
+// Glib::ustring, std::function or vector we make is counted. The tick is
+// meant to make none once it is running so CLOCK::tick() checks the count
+// before and after (-d reports it, -a aborts on it) and 'clock -b tick'
+// fails if the formatting path allocates.
+//
+// Only C++ allocations are seen. GTK's own g_malloc()s inside a redraw are
+// not ours to fix.
+//
+//==============================================================================
+
+#pragma once
+
+// The number of operator new calls since we started
+long allocations();
@@ -0,0 +1,774 @@
+//==============================================================================
+// bench.cpp	Timing runs for the bits of the clock that run every second
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// Started with 'clock -b' from the command line (or 'make bench'), the clock
+// window is never opened. 'render' draws offscreen but GTK still needs a
+// display to talk to so on a headless box use xvfb-run. Each test prints one
+// or two lines of results and any that finds a wrong answer makes the exit
+// code non zero.
+//
+//==============================================================================
+
+#include "bench.h"
+#include "zone.h"
+#include "format.h"
+#include "alloc.h"
+#include "rfc3339.h"
+#include "fetchstate.h"
+#include "http.h"
+#include "json.h"
+#include "eventstore.h"
+#include "nextn.h"
+#include "ics.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+
+// A monotonic clock in nanoseconds for the timings
+static double ns()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec*1e9 + t.tv_nsec;
+}
+
+static bool same(const tm& a, const tm& b)
+{
+	return a.tm_year==b.tm_year && a.tm_mon==b.tm_mon && a.tm_mday==b.tm_mday
+		&& a.tm_hour==b.tm_hour && a.tm_min==b.tm_min && a.tm_sec==b.tm_sec
+		&& a.tm_wday==b.tm_wday && a.tm_yday==b.tm_yday
+		&& a.tm_isdst==b.tm_isdst;
+}
+
+//==============================================================================
+// ZONE against localtime()
+//==============================================================================
+
+static int benchZone()
+{
+	// Check the UK changes (where this clock lives) against the C library.
+	// BST starts at 01:00 UTC on the last Sunday of March and ends at
+	// 01:00 UTC on the last Sunday of October.
+	setenv("TZ", "Europe/London", 1);
+	tzset();
+	ZONE zone;
+	if(!zone.valid()){
+		printf("zone: can't load Europe/London\n");
+		return 1;
+	}
+	int checked = 0, wrong = 0;
+	for(int y=1996; y<=2040; ++y){
+		for(int month : { 3, 10 }){
+			int64_t last = ZONE::days(y, month, 31);
+			int64_t sunday = last - (last%7+11)%7;
+			time_t change = sunday*86400 + 3600;
+			for(time_t t=change-7200; t<=change+7200; ++t){
+				tm a, b;
+				localtime_r(&t, &a);
+				zone.local(t, &b);
+				++checked;
+				if(!same(a, b)){
+					if(++wrong<5)
+						printf("zone: wrong at %ld %02d:%02d:%02d %s\n", long(t),
+							b.tm_hour, b.tm_min, b.tm_sec, b.tm_zone);
+				}
+			}
+		}
+	}
+	printf("zone: %d seconds around BST/GMT changes checked, %d wrong\n",
+															checked, wrong);
+
+	// and the speed, a tick a second for most of a year
+	const int N = 10000000;
+	time_t start = ZONE::days(2026, 1, 1)*86400;
+	tm t;
+	long sum = 0;						// so the optimiser can't skip it
+	double t0 = ns();
+	for(int i=0; i<N; ++i){
+		time_t now = start + i*3;
+		localtime_r(&now, &t);
+		sum += t.tm_sec;
+	}
+	double t1 = ns();
+	for(int i=0; i<N; ++i){
+		time_t now = start + i*3;
+		zone.local(now, &t);
+		sum -= t.tm_sec;
+	}
+	double t2 = ns();
+	printf("zone: localtime_r %.1fnS  ZONE %.1fnS per call (%d lookups)%s\n",
+			(t1-t0)/N, (t2-t1)/N, zone.lookups, sum ? " MISMATCH" : "");
+	return wrong || sum ? 1 : 0;
+}
+
+//==============================================================================
+// The non GTK half of the tick: convert and format with no heap
+//==============================================================================
+
+static int benchTick()
+{
+	ZONE zone;
+	char text[12], date[12], iso[12];
+	const int N = 1000000;
+	time_t start = ::time(nullptr);
+	tm t;
+	zone.local(start, &t);					// first call may look things up
+	long heap = allocations();
+	double t0 = ns();
+	for(int i=0; i<N; ++i){
+		zone.local(start+i, &t);
+		FORMAT::time(text, t, true);
+		FORMAT::date(date, t);
+		FORMAT::iso(iso, t);
+	}
+	double t1 = ns();
+	heap = allocations() - heap;
+
+	// and check the answers against sprintf
+	int wrong = 0;
+	char want[30];
+	for(int i=0; i<100000; ++i){
+		time_t now = start + i*7919;
+		zone.local(now, &t);
+		FORMAT::time(text, t, i&1);
+		if(i&1) sprintf(want, "%02d:%02d:%02d", t.tm_hour, t.tm_min, t.tm_sec);
+		else	sprintf(want, "%02d:%02d", t.tm_hour, t.tm_min);
+		wrong += strcmp(text, want)!=0;
+		FORMAT::date(text, t);
+		sprintf(want, "%02d-%02d-%04d", t.tm_mday, t.tm_mon+1, 1900+t.tm_year);
+		wrong += strcmp(text, want)!=0;
+		FORMAT::iso(text, t);
+		sprintf(want, "%04d-%02d-%02d", 1900+t.tm_year, t.tm_mon+1, t.tm_mday);
+		wrong += strcmp(text, want)!=0;
+	}
+	printf("tick: %.1fnS per tick, %ld heap allocations, %d wrong\n",
+												(t1-t0)/N, heap, wrong);
+	return heap || wrong ? 1 : 0;
+}
+
+//==============================================================================
+// RFC 3339 time stamps, a million of every shape Google might send
+//==============================================================================
+
+static int benchRFC3339()
+{
+	const int N = 1000000;
+	std::string text;
+	std::vector<size_t> at;
+	std::vector<int64_t> want;
+	srand(3339);
+	for(int i=0; i<N; ++i){
+		// the answer first and then write it in one of several ways
+		int64_t utc = ZONE::days(1990, 1, 1)*86400 + int64_t(rand())%(60LL*366*86400);
+		int offset = (rand()%57 - 28) * 30*60;		// -14:00 to +14:00
+		int kind = i%5;
+		if(kind==4) utc -= utc%86400;				// a date on its own
+		int64_t wall = utc + (kind==0 || kind==4 ? 0 : offset);
+		int64_t day = wall>=0 ? wall/86400 : (wall-86399)/86400;
+		int secs = int(wall - day*86400);
+		int y, m, d;
+		ZONE::civil(day, y, m, d);
+		char temp[64];
+		int n = snprintf(temp, sizeof(temp), "%04d-%02d-%02d", y, m, d);
+		if(kind!=4)
+			n += snprintf(temp+n, sizeof(temp)-n, "T%02d:%02d:%02d",
+								secs/3600, secs/60%60, secs%60);
+		if(kind==2)
+			n += snprintf(temp+n, sizeof(temp)-n, ".%03d", rand()%1000);
+		if(kind==0)
+			n += snprintf(temp+n, sizeof(temp)-n, "Z");
+		else if(kind!=4)
+			n += snprintf(temp+n, sizeof(temp)-n, "%c%02d:%02d",
+						offset<0 ? '-' : '+', abs(offset)/3600, abs(offset)/60%60);
+		at.push_back(text.size());
+		text.append(temp, n);
+		want.push_back(utc);
+	}
+	at.push_back(text.size());
+
+	int wrong = 0;
+	int64_t sum = 0;
+	double t0 = ns();
+	for(int i=0; i<N; ++i){
+		RFC3339 t;
+		if(!t.parse(text.data()+at[i], at[i+1]-at[i]))
+			++wrong;
+		sum += t.utc;
+	}
+	double t1 = ns();
+	for(int i=0; i<N; ++i){
+		RFC3339 t;
+		t.parse(text.data()+at[i], at[i+1]-at[i]);
+		if(t.utc!=want[i] && ++wrong<5)
+			printf("rfc3339: %.*s gave %ld not %ld\n", int(at[i+1]-at[i]),
+					text.data()+at[i], long(t.utc), long(want[i]));
+	}
+	// and some that must be turned down
+	static const char* bad[] = { "2022-13-01", "2022-02-29", "2022-10-13T24:00:00Z",
+		"2022-10-13T12:00:00+01", "2022-10-13T12:00:00.Z", "2022-10-13X12:00:00Z",
+		"2022-10-13T12:00:00Zx", "20221013", "2022-10-13T12:0:00Z", "" };
+	for(const char* b : bad){
+		RFC3339 t;
+		if(t.parse(b) && ++wrong<10)
+			printf("rfc3339: took %s\n", b);
+	}
+	for(int64_t w : want)					// the timed loop got them all
+		sum -= w;
+	printf("rfc3339: %.1fnS per stamp, %.0fMB/S, %d wrong%s\n", (t1-t0)/N,
+			text.size()/((t1-t0)/1e9)/1e6, wrong, sum ? " MISMATCH" : "");
+	return wrong || sum ? 1 : 0;
+}
+
+//==============================================================================
+// HTTPPARSE and JSON on canned answers, no network
+//==============================================================================
+
+// Squash text the way a server does for Content-Encoding: gzip
+static std::string gzip(const std::string& text)
+{
+	z_stream z{};
+	deflateInit2(&z, Z_BEST_SPEED, Z_DEFLATED, 16+MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+	std::string out(deflateBound(&z, text.size()) + 32, '\0');
+	z.next_in = (Bytef*)text.data();
+	z.avail_in = text.size();
+	z.next_out = (Bytef*)&out[0];
+	z.avail_out = out.size();
+	deflate(&z, Z_FINISH);
+	out.resize(out.size() - z.avail_out);
+	deflateEnd(&z);
+	return out;
+}
+
+// Feed an answer in pieces of 'step' bytes (0 for all at once) and say if
+// the server hangs up at the end
+static HTTPPARSE parse(const std::string& answer, size_t step, bool bHangUp)
+{
+	HTTPPARSE h;
+	if(step==0) step = answer.size();
+	for(size_t i=0; i<answer.size() && h.feed(answer.data()+i,
+							std::min(step, answer.size()-i)); i+=step)
+		;
+	if(bHangUp)
+		h.eof();
+	return h;
+}
+
+static int benchHTTP()
+{
+	int wrong = 0, tried = 0;
+	auto check = [&wrong, &tried](bool ok, const char* what, size_t step){
+		++tried;
+		if(!ok && ++wrong<10){
+			if(step)
+				printf("http: %s (in %zu byte pieces)\n", what, step);
+			else
+				printf("http: %s\n", what);
+		}
+	};
+	const std::string body = "{\"items\": [{\"id\": \"one\", \"summary\": \"Lunch\"}]}";
+
+	// each framing, all at once, a byte at a time and a few sizes between so
+	// the chunk sizes and CRLFs get split across reads every way they can
+	const std::string length = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+			"Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+	const std::string chunked = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+			"a\r\n" + body.substr(0, 10) + "\r\n"
+			"3;name=value\r\n" + body.substr(10, 3) + "\r\n"
+			+ [&]{ char n[16]; snprintf(n, sizeof(n), "%zX", body.size()-13);
+				   return std::string(n); }() + "\r\n" + body.substr(13) + "\r\n"
+			"0\r\nX-Trailer: yes\r\n\r\n";
+	const std::string zipped = gzip(body);
+	const std::string gzipped = "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\n"
+			"Content-Length: " + std::to_string(zipped.size()) + "\r\n\r\n" + zipped;
+	const std::string untilClose = "HTTP/1.0 200 OK\r\nServer: old\r\n\r\n" + body;
+	for(size_t step : { size_t(0), size_t(1), size_t(2), size_t(3), size_t(7),
+														size_t(64) }){
+		HTTPPARSE h = parse(length, step, false);
+		check(h.done() && h.r.status==200 && h.r.body==body && !h.bClose,
+				"Content-Length", step);
+		check(h.r.header("content-type")
+			  && strcmp(h.r.header("content-type"), "application/json")==0,
+				"headers by any case", step);
+		h = parse(chunked, step, false);
+		check(h.done() && h.r.body==body, "chunked", step);
+		h = parse(gzipped, step, false);
+		check(h.done() && h.r.body==body, "gzip", step);
+		h = parse(untilClose, step, false);
+		check(!h.done() && !h.failed(), "finished before the hang up", step);
+		h = parse(untilClose, step, true);
+		check(h.done() && h.r.body==body && h.bClose, "read until close", step);
+	}
+
+	// gzip'ed and chunked together, which is what Google sends
+	std::string both = "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\n"
+			"Transfer-Encoding: chunked\r\n\r\n";
+	for(size_t i=0; i<zipped.size(); i+=5){
+		std::string part = zipped.substr(i, 5);
+		char n[16];
+		snprintf(n, sizeof(n), "%zx\r\n", part.size());
+		both += n + part + "\r\n";
+	}
+	both += "0\r\n\r\n";
+	HTTPPARSE h = parse(both, 1, false);
+	check(h.done() && h.r.body==body, "gzip in chunks", 1);
+
+	// things that must not come out as answers
+	h = parse("HTTP/1.1 204 No Content\r\n\r\n", 0, false);
+	check(h.done() && h.r.status==204 && h.r.body.empty(), "204 has no body", 0);
+	h = parse("HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\nshort", 0, true);
+	check(h.failed(), "a short body passed", 0);
+	h = parse("SSH-2.0-OpenSSH\r\n", 0, false);
+	check(h.failed(), "not HTTP passed", 0);
+	h = parse("HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\n"
+			  "Content-Length: 4\r\n\r\nnope", 0, false);
+	check(h.failed(), "bad gzip passed", 0);
+	h = parse("HTTP/1.1 200 OK\r\nX: " + std::string(20000, 'x'), 1000, false);
+	check(h.failed(), "an endless header passed", 1000);
+	h = parse("", 0, true);
+	check(h.failed(), "nothing at all passed", 0);
+
+	// Google's answers as gcal.h reads them
+	JSON j;
+	check(j.parse("{\n \"kind\": \"calendar#events\",\n \"items\": [\n  {\n"
+			"   \"id\": \"abc123\",\n   \"summary\": \"Caf\\u00e9 \\ud83d\\ude00 \\\"x\\\"\",\n"
+			"   \"start\": {\"dateTime\": \"2022-10-13T12:00:00+01:00\"},\n"
+			"   \"end\": {\"dateTime\": \"2022-10-13T13:00:00+01:00\"}\n  },\n"
+			"  {\"id\": \"d\", \"start\": {\"date\": \"2022-10-14\"},"
+			" \"end\": {\"date\": \"2022-10-15\"}}\n ],\n"
+			" \"nextPageToken\": null, \"accessRole\": \"owner\", \"n\": -1.5e2\n}\n"),
+			"events.list didn't parse", 0);
+	check(j["items"].size()==2 && strcmp(j["items"][size_t(0)]["id"].str(), "abc123")==0,
+			"events.list items", 0);
+	check(strcmp(j["items"][size_t(0)]["summary"].str(),
+				 "Caf\xc3\xa9 \xf0\x9f\x98\x80 \"x\"")==0, "escapes and UTF-8", 0);
+	check(strcmp(j["items"][1]["start"]["dateTime"].str(
+				 j["items"][1]["start"]["date"].str()), "2022-10-14")==0
+		  && j["items"][1]["start"]["dateTime"].isNull(), "all day start", 0);
+	check(j["nextPageToken"].isNull() && j["missing"]["deeper"][size_t(3)].isNull()
+		  && j["n"].n==-150, "nulls and numbers", 0);
+	check(j.parse("{\"access_token\": \"ya29.a0Af\", \"expires_in\": 3599,"
+			" \"scope\": \"https://www.googleapis.com/auth/calendar.readonly\","
+			" \"token_type\": \"Bearer\"}")
+		  && strcmp(j["access_token"].str(), "ya29.a0Af")==0
+		  && j["expires_in"].n==3599, "token answer", 0);
+	check(j.parse("{\"error\": \"invalid_grant\", \"error_description\":"
+			" \"Token has been expired or revoked.\"}")
+		  && strcmp(j["error"].str(), "invalid_grant")==0, "token error", 0);
+	static const char* const bad[] = {
+		"", "{", "{\"a\":}", "{\"a\" 1}", "[1,]", "[1 2]", "{\"a\":1}x",
+		"\"\\u12\"", "\"\\ud83d\\u0041\"", "\"open", "tru", "nul", "-",
+		"{'a': 1}", "[1e999999999999999999999999999999999999999999999999999999999"
+		"999999999999999]",
+	};
+	for(const char* text : bad){
+		JSON k;
+		check(!k.parse(text, strlen(text)), text, 0);
+	}
+	std::string deep(200, '[');
+	check(!j.parse(deep + std::string(200, ']')), "200 deep didn't stop", 0);
+
+	printf("http: %d framing and JSON checks, %d wrong\n", tried, wrong);
+	return wrong ? 1 : 0;
+}
+
+//==============================================================================
+// FETCHSTATE driven by a pretend clock, no waiting
+//==============================================================================
+
+static int benchFetchState()
+{
+	time_t now = 1000000;
+	std::string log;
+	int wrong = 0;
+	auto check = [&wrong](bool ok, const char* what){
+		if(!ok && ++wrong<10)
+			printf("fetchstate: %s\n", what);
+	};
+	FETCHSTATE f;
+	f.clock = [&now]{ return now; };
+	f.log   = [&log](const char* text){ log += text; log += '\n'; };
+	f.seed  = 20;
+
+	// network failures back off 60, 120, 240... up to the cap, each 50-100%
+	int base = f.first;
+	for(int i=0; i<12; ++i){
+		check(f.start("test"), "start refused while backing off");
+		now += 5;
+		int wait = f.finished(CALENDAR::NETWORK);
+		check(wait>=base/2 && wait<=base, "backoff outside 50-100%");
+		check(f.now()==FETCHSTATE::BACKOFF, "not BACKOFF after a failure");
+		check(f.failed()==i+1, "failures not counted");
+		now += wait;
+		base = std::min(base*2, f.cap);
+	}
+	check(base==3600, "never reached the cap");
+
+	// the jitter covers its band rather than sitting in one place
+	int lo = INT_MAX, hi = 0;
+	for(unsigned seed=0; seed<1000; ++seed){
+		FETCHSTATE g;
+		g.clock = [&now]{ return now; };
+		g.log   = [](const char*){};
+		g.seed  = seed;
+		for(int i=0; i<10; ++i){
+			g.start("test");
+			int wait = g.finished(CALENDAR::WORKER);
+			if(i==9){
+				lo = std::min(lo, wait);
+				hi = std::max(hi, wait);
+			}
+		}
+	}
+	check(lo>=1800 && lo<1900 && hi<=3600 && hi>3500, "jitter not 50-100%");
+
+	// a good fetch forgets the backoff
+	f.start("test");
+	check(f.finished(CALENDAR::NONE)==0, "success didn't say use the schedule");
+	check(f.now()==FETCHSTATE::IDLE && f.failed()==0, "success didn't reset");
+	f.start("test");
+	int wait = f.finished(CALENDAR::NETWORK);
+	check(wait>=30 && wait<=60, "backoff didn't start again at a minute");
+
+	// a dead token breaks it until reset(), however long we wait
+	f.start("test");
+	check(f.finished(CALENDAR::AUTH)==-1, "AUTH didn't say stop");
+	check(f.now()==FETCHSTATE::BROKEN, "AUTH didn't go BROKEN");
+	now += 7*86400;
+	check(!f.start("a week later"), "started while BROKEN");
+	check(f.now()==FETCHSTATE::BROKEN, "BROKEN didn't stay");
+	f.reset("new token.json");
+	check(f.now()==FETCHSTATE::IDLE && f.failed()==0, "reset didn't close it");
+	check(f.start("test"), "start refused after reset");
+
+	// the log has the times from our clock
+	check(log.find("BACKOFF -> BROKEN")==std::string::npos, "impossible move");
+	check(log.find("BROKEN -> IDLE after 604800s: new token.json")
+						!=std::string::npos, "log times not from 'clock'");
+
+	printf("fetchstate: backoff to %dS, jitter %d-%dS at the cap,"
+			" %d wrong\n", f.cap, lo, hi, wrong);
+	return wrong ? 1 : 0;
+}
+
+//==============================================================================
+// EVENTSTORE queries against looking at every event
+//==============================================================================
+
+static int benchStore()
+{
+	// A year of 100,000 events: mostly meetings, some all day and a few that
+	// go on for weeks (holidays) which are the ones a plain sorted list
+	// can't skip past
+	const int N = 100000, Q = 100000;
+	const int64_t year = 365*86400LL, base = ZONE::days(2026, 1, 1)*86400;
+	std::vector<EVENTSTORE::INTERVAL> all;
+	srand(21);
+	for(int i=0; i<N; ++i){
+		int64_t start = base + int64_t(rand())%year;
+		int64_t length = (rand()%6 + 1) * 30*60;
+		if(i%10==0){ start -= start%86400; length = 86400; }
+		if(i%1000==0) length = (rand()%21 + 1) * 86400LL;
+		all.push_back(EVENTSTORE::INTERVAL{start, start+length, uint32_t(i)});
+	}
+	EVENTSTORE store;
+	double t0 = ns();
+	for(auto& e : all)
+		store.add(e.start, e.end, e.index);
+	store.index();
+	double t1 = ns();
+
+	// the same questions timed and then checked against the lot
+	std::vector<int64_t> when(Q);
+	for(auto& t : when)
+		t = base + int64_t(rand())%year;
+	long sum = 0;
+	double t2 = ns();
+	for(int64_t t : when)
+		sum += store.now(t, [](const EVENTSTORE::INTERVAL&){ return true; });
+	double t3 = ns();
+	for(int64_t t : when)
+		sum += store.next(t, 10, [](const EVENTSTORE::INTERVAL&){ return true; });
+	double t4 = ns();
+	for(int64_t t : when)
+		sum += store.overlap(t, t+86400, [](const EVENTSTORE::INTERVAL&){ return true; });
+	double t5 = ns();
+
+	int wrong = 0;
+	long brute = 0;
+	double slow = 0;
+	for(int q=0; q<Q; q+=100){
+		int64_t a = when[q], b = a+86400;
+		std::vector<uint32_t> got, want;
+		int64_t last = INT64_MIN;
+		store.overlap(a, b, [&](const EVENTSTORE::INTERVAL& e){
+				if(e.start<last) ++wrong;			// out of order
+				last = e.start;
+				got.push_back(e.index);
+				return true; });
+		double t6 = ns();
+		for(auto& e : all)
+			if(e.start<b && a<e.end)
+				want.push_back(e.index);
+		slow += ns()-t6;
+		brute += want.size();
+		std::sort(got.begin(), got.end());
+		if(got!=want && ++wrong<5)
+			printf("store: [%ld,%ld) gave %zu not %zu\n", long(a), long(b),
+												got.size(), want.size());
+	}
+	printf("store: %d events indexed in %.1fmS, per query now %.0fnS, next 10 "
+			"%.0fnS, a day %.0fnS (looking at them all %.0fnS), %d wrong\n",
+			N, (t1-t0)/1e6, (t3-t2)/Q, (t4-t3)/Q, (t5-t4)/Q, slow/(Q/100),
+			wrong);
+	return wrong || !sum || !brute ? 1 : 0;
+}
+
+//==============================================================================
+// NEXTN streaming a gigabyte of events
+//==============================================================================
+
+// The most memory we have used since the last call, in kB. Writing 5 to
+// clear_refs starts the count again (Linux 4.0 on).
+static long peakRSS()
+{
+	long kb = 0;
+	FILE* f = fopen("/proc/self/status", "r");
+	if(f){
+		char line[128];
+		while(fgets(line, sizeof(line), f))
+			if(sscanf(line, "VmHWM: %ld", &kb)==1)
+				break;
+		fclose(f);
+	}
+	f = fopen("/proc/self/clear_refs", "w");
+	if(f){
+		fputs("5", f);
+		fclose(f);
+	}
+	return kb;
+}
+
+static int benchNextN()
+{
+	// A gigabyte of events.txt lines in no order with the odd error line,
+	// twenty years of them with 'now' in the middle so half are in the past.
+	// Keep the five earliest after now as we go so we know the answer.
+	const long SIZE = 1L<<30;
+	const char* dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+	std::string path = std::string(dir) + "/nextnXXXXXX";
+	int fd = mkstemp(&path[0]);
+	if(fd<0){
+		printf("nextn: can't make a file in %s\n", dir);
+		return 1;
+	}
+	unlink(path.c_str());					// gone when we close it
+	ZONE zone;
+	const int64_t now = ZONE::days(2030, 1, 1)*86400;
+	std::vector<char> block(1<<20);
+	int64_t want[5] = { INT64_MAX, INT64_MAX, INT64_MAX, INT64_MAX, INT64_MAX };
+	long written = 0, lines = 0;
+	srand(23);
+	while(written<SIZE){
+		size_t used = 0;
+		while(used+100<block.size()){
+			int n;
+			if(rand()%1000==0)
+				n = snprintf(&block[used], 100, "* An HTTP error occurred *\n");
+			else{
+				int64_t utc = ZONE::days(2020, 1, 1)*86400
+							+ (int64_t(rand())*rand()) % (20LL*365*86400);
+				tm t;
+				zone.local(utc, &t);
+				char when[12], hms[12];
+				FORMAT::iso(when, t);
+				FORMAT::time(hms, t, true);
+				n = snprintf(&block[used], 100, "%sT%s%+03ld:%02ld Event number %ld\n",
+						when, hms, t.tm_gmtoff/3600, labs(t.tm_gmtoff)/60%60, lines);
+				if(utc>now && utc<want[4]){	// insert it in order
+					int i = 4;
+					for( ; i>0 && want[i-1]>utc; --i)
+						want[i] = want[i-1];
+					want[i] = utc;
+				}
+			}
+			used += n;
+			++lines;
+		}
+		if(write(fd, block.data(), used)!=(ssize_t)used){
+			printf("nextn: can't write %s\n", path.c_str());
+			close(fd);
+			return 1;
+		}
+		written += used;
+	}
+	block = std::vector<char>();
+
+	lseek(fd, 0, SEEK_SET);
+	peakRSS();
+	NEXTN next(5, now);
+	std::vector<std::string> errors;
+	double t0 = ns();
+	bool ok = next.read(fd, zone, errors);
+	double t1 = ns();
+	long peak = peakRSS();
+	close(fd);
+
+	int wrong = ok ? 0 : 1;
+	const auto& got = next.sorted();
+	for(const auto& e : got)
+		if(e.end<=now && ++wrong<5)
+			printf("nextn: %s is in the past\n", e.when.c_str());
+	for(int i=0; i<5; ++i)
+		if((i>=(int)got.size() || got[i].start!=want[i]) && ++wrong<5)
+			printf("nextn: %d is %ld not %ld\n", i,
+					i<(int)got.size() ? long(got[i].start) : 0L, long(want[i]));
+	if(next.seen+long(errors.size())>lines || errors.size()!=5)
+		++wrong;
+	printf("nextn: %ldMB %ld lines in %.2fS, %.0fMB/S %.1fM lines/S,"
+			" peak RSS %ldkB, %d wrong\n", written>>20, lines, (t1-t0)/1e9,
+			written/((t1-t0)/1e9)/1e6, lines/((t1-t0)/1e9)/1e6, peak, wrong);
+	return wrong ? 1 : 0;
+}
+
+//==============================================================================
+// ICS reading a big .ics file
+//==============================================================================
+
+// Fold a line at 75 bytes the way RFC 5545 says
+static void folded(std::string& out, const char* line)
+{
+	size_t n = strlen(line);
+	for(size_t i=0; i<n; i+=74){
+		if(i) out += ' ';
+		out.append(line+i, std::min<size_t>(74, n-i));
+		out += "\r\n";
+	}
+}
+
+static int benchICS()
+{
+	// 64MB of events in no order in a London TZID (kept to the day time so
+	// none land in a clock change), folded, escaped, with alarms and every
+	// fiftieth repeating fortnightly. The answer is the first five of them
+	// and the three of a weekly repeat from December that are left in 2020.
+	const size_t SIZE = 64<<20;
+	ZONE london;
+	if(!london.load("Europe/London")){
+		printf("ics: no Europe/London zone file\n");
+		return 1;
+	}
+	const int64_t after = ZONE::days(2020, 1, 1)*86400;
+	std::string file = "BEGIN:VCALENDAR\r\nVERSION:2.0\r\nPRODID:-//Pi-Clock//bench//EN\r\n"
+			"BEGIN:VEVENT\r\nUID:planted\r\nDTSTART:20191202T100000Z\r\n"
+			"DURATION:PT1H\r\nRRULE:FREQ=WEEKLY;COUNT=8\r\nSUMMARY:Planted\r\n"
+			"END:VEVENT\r\n";
+	int64_t want[5] = { after+5*86400+36000, after+12*86400+36000,
+						after+19*86400+36000, INT64_MAX, INT64_MAX };
+	long events = 1;
+	char line[200];
+	srand(25);
+	while(file.size()<SIZE){
+		int64_t day = ZONE::days(2020, 1, 10) + rand()%(20*365);
+		int y, m, d;
+		ZONE::civil(day, y, m, d);
+		int hh = 9 + rand()%8, mm = rand()%4*15;
+		tm t;
+		int64_t wall = day*86400 + hh*3600 + mm*60;
+		london.local(wall, &t);
+		int64_t utc = wall - t.tm_gmtoff;
+		london.local(utc, &t);
+		utc = wall - t.tm_gmtoff;
+		file += "BEGIN:VEVENT\r\n";
+		snprintf(line, sizeof(line), "UID:%ld@bench.pi-clock", events);
+		folded(file, line);
+		file += "DTSTAMP:20261016T120000Z\r\n";
+		snprintf(line, sizeof(line), "DTSTART;TZID=Europe/London:%04d%02d%02dT%02d%02d00",
+																y, m, d, hh, mm);
+		folded(file, line);
+		snprintf(line, sizeof(line), "DTEND;TZID=Europe/London:%04d%02d%02dT%02d%02d00",
+																y, m, d, hh+1, mm);
+		folded(file, line);
+		snprintf(line, sizeof(line), "SUMMARY:Event number %ld\\, in room %d", events,
+																rand()%100);
+		folded(file, line);
+		folded(file, "DESCRIPTION:A long description that goes on well past the"
+				" seventy five bytes a line may have so it has to be folded\\nand"
+				" has an escaped new line in it too");
+		if(events%50==0)
+			file += "RRULE:FREQ=WEEKLY;INTERVAL=2;COUNT=20\r\n";
+		file += "BEGIN:VALARM\r\nACTION:DISPLAY\r\nTRIGGER:-PT15M\r\nEND:VALARM\r\n"
+				"END:VEVENT\r\n";
+		if(utc<want[4]){					// insert it in order
+			int i = 4;
+			for( ; i>0 && want[i-1]>utc; --i)
+				want[i] = want[i-1];
+			want[i] = utc;
+		}
+		++events;
+	}
+	file += "END:VCALENDAR\r\n";
+
+	// feed it 64K at a time as read() would
+	ZONE zone;
+	NEXTN next(5, after);
+	ICS ics(next, zone);
+	double t0 = ns();
+	for(size_t i=0; i<file.size(); i+=1<<16)
+		ics.feed(file.data()+i, std::min<size_t>(1<<16, file.size()-i));
+	ics.finish();
+	double t1 = ns();
+
+	int wrong = 0;
+	const auto& got = next.sorted();
+	for(int i=0; i<5; ++i)
+		if((i>=(int)got.size() || got[i].start!=want[i]) && ++wrong<5)
+			printf("ics: %d is %ld not %ld\n", i,
+					i<(int)got.size() ? long(got[i].start) : 0L, long(want[i]));
+	if(ics.events!=events || ics.bad)
+		++wrong;
+	double secs = (t1-t0)/1e9;
+	printf("ics: %zuMB %ld events in %.2fS, %.0fMB/S %.2fM events/S, %d wrong\n",
+			file.size()>>20, events, secs, file.size()/secs/1e6, events/secs/1e6,
+			wrong);
+	return wrong ? 1 : 0;
+}
+
+//==============================================================================
+// The list of benchmarks
+//==============================================================================
+
+int bench(int argc, char* argv[])
+{
+	static const struct { const char* name; int (*run)(); } list[] = {
+		{ "zone",	benchZone	},
+		{ "tick",	benchTick	},
+		{ "rfc3339", benchRFC3339 },
+		{ "http",	benchHTTP	},
+		{ "fetchstate", benchFetchState },
+		{ "store",	benchStore	},
+		{ "nextn",	benchNextN	},
+		{ "ics",	benchICS	},
+		{ "render",	benchRender	},
+	};
+	int result = 0;
+	for(auto& b : list){
+		bool wanted = argc<2;
+		for(int i=1; i<argc; ++i)
+			if(strcmp(argv[i], b.name)==0)
+				wanted = true;
+		if(wanted)
+			result |= b.run();
+	}
+	return result;
+}
@@ -0,0 +1,14 @@
+//==============================================================================
+// bench.h		Timing runs for the bits of the clock that run every second
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+
+#pragma once
+
+// Run the benchmarks named on the command line (all of them if none are)
+// and return the exit code for main()
+//		clock -b [zone] [tick] [rfc3339] [http] [fetchstate] [store] [nextn] [ics] [render]...
+int bench(int argc, char* argv[]);
+
+// The offscreen drawing one is in clock.cpp as it needs CLOCK
+int benchRender();
@@ -0,0 +1,33 @@
+//==============================================================================
+// calendar.h	What a calendar fetch brings back
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// Whichever way we get the calendar (clock.py down a pipe or gcal.h) the
+// answer is how it went. If it worked the events are in events.bin (see
+// snapshot.h) and if not the lines say why, as events.txt would
+//		* something bad happened
+// and 'error' sorts it so FETCHSTATE knows whether trying again will help.
+//
+//==============================================================================
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct CALENDAR {
+	enum ERROR {
+		NONE,								// it worked
+		NETWORK,							// no answer, a timeout or a 5xx
+		AUTH,								// the refresh token is dead
+		WORKER,								// clock.py died or wouldn't start
+		DATA								// an answer we couldn't use
+	};
+	bool	ok{false};						// events.bin is up to date
+	ERROR	error{NONE};					// and if not, why not
+	std::vector<std::string> lines;			// what went wrong
+	char	text[80]{};						// a few words for the screen
+};
@@ -33,6 +33,31 @@
 // 2022-10-26  add code for Z duration (seen new today)
 // 2022-10-27  add command arguments and lambdas
 // 2022-11-01  fix error reporting on token timeout
+// 2026-10-16  lock the tick to the real second with a timerfd, add -d stats
+// 2026-10-16  redraw and replan the fetch when the real clock is stepped
+// 2026-10-16  add -g to draw the time from pre-rendered glyphs
+// 2026-10-16  only repaint labels that changed and count the damage
+// 2026-10-16  fix the sizes so the tick never relayouts, glyphs by default
+// 2026-10-16  add -m for a minutes only clock, calendar on its own timers
+// 2026-10-16  do our own local time from the zone file, add -b benchmarks
+// 2026-10-16  no heap allocations in the tick, add -a to enforce it
+// 2026-10-16  add an offscreen render benchmark and 'make bench'
+// 2026-10-16  run clock.py with posix_spawn and reap it, no more zombies
+// 2026-10-16  keep clock.py running as a worker and ask it to fetch
+// 2026-10-16  add -n to read the calendar natively (gcal.h), -u for its URL
+// 2026-10-16  clock.py syncs changes only so fetch every fifteen minutes
+// 2026-10-16  the worker sends the events down its pipe, no more events.txt
+// 2026-10-16  watch for a new events.txt or token.json instead of waiting
+// 2026-10-16  events come in events.bin and are read in place, add -x
+// 2026-10-16  show events in local time whatever offset Google used
+// 2026-10-16  show the last events at startup and their age, add -s
+// 2026-10-16  plan fetches around the next event, the night and a budget
+// 2026-10-16  back off after failures, stop on a dead token until a new one
+// 2026-10-16  keep the events in an interval store, show the unfinished ones
+// 2026-10-16  drop finished events and recolour at midnight without a fetch
+// 2026-10-16  events.txt can be any size in any order, keep the first five
+// 2026-10-16  several calendars fetched at once and merged, a colour each
+// 2026-10-16  add -i to read a local .ics file, the sources are EVENTSOURCEs
 //
 // For Eclipse this requires the pkg-config plugin
 //   Help | Eclipse Market place
@@ -52,8 +77,30 @@
 #include <gtkmm/fixed.h>
 #include <gtkmm/main.h>
 #include <gtkmm/cssprovider.h>
+#include <gtkmm/offscreenwindow.h>
 #include <glibmm/main.h>
+#include <giomm/file.h>
 #include <iostream>
+#include <climits>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include "ticker.h"
+#include "glyphs.h"
+#include "label.h"
+#include "zone.h"
+#include "bench.h"
+#include "format.h"
+#include "alloc.h"
+#include "worker.h"
+#include "gcal.h"
+#include "icssource.h"
+#include "snapshot.h"
+#include "rfc3339.h"
+#include "schedule.h"
+#include "fetchstate.h"
+#include "eventstore.h"
+#include "nextn.h"
 
 // Define some CSS so we can set colours and fonts and stuff
 // I break it into lines with \n so we get useful error messages
@@ -72,12 +119,14 @@ static const char *css =
 " border-radius: 5px;\n"
 " border-color: white\n"
 " }\n"
-"label#aval {\n"						// distinguish Gtk::Labels by name
+"#aval {\n"							// distinguish widgets by name
 " color: white;\n"
+" font-feature-settings: 'tnum';\n"	// all digits the same width
 " font-size: 250px\n"
 " }\n"
 "label#bval {\n"
 " color: lawngreen;\n"
+" font-feature-settings: 'tnum';\n"
 " font-size: 100px\n"
 " }\n"
 "label#sval1 {\n"
@@ -88,8 +137,28 @@ static const char *css =
 " color: royalblue;\n"
 " font-size: 60px\n"
 " }\n"
+"label#sval1.cal1 { color: orange }\n"	// each calendar after the first
+"label#sval2.cal1 { color: orchid }\n"		// in calendars.txt has a class,
+"label#sval1.cal2 { color: gold }\n"		// today and other days
+"label#sval2.cal2 { color: mediumseagreen }\n"
+"label#sval1.cal3 { color: deeppink }\n"
+"label#sval2.cal3 { color: turquoise }\n"
+"label#cval {\n"						// the small print at the bottom
+" color: grey;\n"
+" font-size: 20px\n"
+" }\n"
+"label#cstale {\n"					// the events are getting old
+" color: orange;\n"
+" font-size: 20px\n"
+" }\n"
 ;
 
+// Where clock.py lives, events.txt is only read in test mode now
+#define CALDIR	"/home/pi/calendar"
+static const char* eventsFile   = CALDIR "/events.txt";
+static const char* responseFile = CALDIR "/response.edc";
+static const char* snapFile     = CALDIR "/events.bin";
+
 // Now the class that defines our main window
 // I have coded it with the functions 'inline' C# style
 
@@ -101,10 +170,30 @@ protected:
 	// Member widgets:
 	Gtk::Fixed fixed;				// a widget container with fixed coordinates
 	Gtk::Button close, refresh;		// buttons
-	Gtk::Label time, day, date;		// blocks of text
-	Gtk::Label slot[5];				// more text for the calendar entries
+	LABEL time, day, date;			// blocks of text (see label.h)
+	GLYPHS digits{ "0123456789:", "00:00:00" };	// the time done fast
+	LABEL slot[5];					// more text for the calendar entries
+	LABEL status;					// how the last fetch went
+	LABEL stale;					// and how old the events are
 
 	bool bTest{ false };			// used when testing
+	bool bDebug{ false };			// print timing statistics
+	bool bGlyphs{ true };			// draw the time with 'digits' not 'time'
+	bool bMinutes{ false };			// no seconds and one tick a minute
+	bool bAllocAbort{ false };		// abort if a steady tick allocates
+	int staleAfter{ 3*60 };			// minutes before we say events are old
+	int layouts{0};					// size allocations since the last report
+	int wakeups{0};					// timer calls since the last report
+	long ticks{0};					// since we started
+	int allocTicks{0};				// steady state ticks that used the heap
+
+	TICKER ticker;					// the once a second (or minute) wake up
+	JITTER jitter;					// how late in the second we painted
+	double cpuMark{0};				// process CPU time at the last report
+
+	ZONE zone;						// UTC to local time (see zone.h)
+	Glib::RefPtr<Gio::FileMonitor> zoneWatch[2];	// the link and the file
+	Glib::RefPtr<Gio::FileMonitor> calWatch;		// events.txt and token.json
 
 public:
 	CLOCK() = delete;							// no default constructor
@@ -145,15 +234,29 @@ public:
 							provider, GTK_STYLE_PROVIDER_PRIORITY_USER);
 
 		// Give the labels CSS names so we can distinguish them
-		time.set_name("aval");			// ie: use label#aval
+		time.set_name("aval");			// ie: use #aval
+		digits.set_name("aval");
 		day.set_name("bval");
 		date.set_name("bval");
+
+		// Fix the sizes so changing the text never makes GTK rework the
+		// layout of the whole window
+		time.fix("00:00:00");
+		day.fix("Wednesday");
+		date.fix("00-00-0000");
+		fixed.signal_size_allocate().connect(
+							[this](Gtk::Allocation&){ ++layouts; });
 		for(int i=0; i<5; ++i)
-			slot[i].set_name("sval1");
+			slot[i].name("sval1");
+		status.name("cval");
+		stale.name("cstale");
 
 		// Connect the buttons to their service routines as lambdas
 		close.signal_clicked().connect([this]{ return Gtk::Window::close(); });
-		refresh.signal_clicked().connect([this]{ Ticks = 12; });
+		refresh.signal_clicked().connect([this]{
+				schedule.refresh(::time(nullptr));
+				fetchState.reset("Refresh");
+				if(!bFetching) planFetch(2, "Refresh"); });
 
 		// And the command line argument receiver
 		// more messy as it is a static
@@ -176,17 +279,99 @@ public:
 
 		// Put the labels into the container
 		fixed.put(time, 100,  70);
+		fixed.put(digits, 100, 70);		// same place, only one is shown
 		fixed.put(day,  95,  320);
 		fixed.put(date, 720, 320);
 		for(int i=0; i<5; ++i)
 			fixed.put(slot[i], 60, 455+i*70);
+		fixed.put(status, 25, 815);
+		fixed.put(stale, 1000, 815);
 
 		// The final step is to display all these newly created widgets...
 		show_all_children();
+		time.hide();					// unless the command line says
 
-		// Make a timer to call CLOCK::tick() every 1000mS
+		// Make a timer to call CLOCK::tick() on every second of the real
+		// clock (see ticker.h for why not just signal_timeout every 1000mS)
 		// I'll use a lambda again to save a layer of indirection
-		Glib::signal_timeout().connect([this]() { return this->tick(); }, 1000);
+		ticker.start([this](const timespec& now){ this->tick(now); },
+					 [this](const timespec& now){ this->clockChanged(now); });
+
+		// Reload the time zone if somebody changes it (the link) or the
+		// tzdata package is updated (the file it points at)
+		char real[PATH_MAX];
+		const char* zoneFiles[2] = { "/etc/localtime",
+						realpath("/etc/localtime", real) ? real : nullptr };
+		for(int i=0; i<2 && zoneFiles[i]; ++i){
+			zoneWatch[i] = Gio::File::create_for_path(zoneFiles[i])->monitor_file();
+			zoneWatch[i]->signal_changed().connect(
+				[this](const Glib::RefPtr<Gio::File>&, const Glib::RefPtr<Gio::File>&,
+					   Gio::FileMonitorEvent event){
+					if(event==Gio::FILE_MONITOR_EVENT_CHANGES_DONE_HINT ||
+					   event==Gio::FILE_MONITOR_EVENT_CREATED){
+						zone.load();
+						oldDOW = 9;			// redo the date too
+					}
+				});
+		}
+
+		// Watch the calendar folder. A new events.bin (or events.txt in
+		// test mode) is shown straight away. Whoever writes them does it
+		// under another name and renames it so they are always complete.
+		// A new token.json means somebody has done the browser dance so
+		// try again now rather than in an hour.
+		calWatch = Gio::File::create_for_path(CALDIR)->monitor_directory(
+												Gio::FILE_MONITOR_WATCH_MOVES);
+		calWatch->signal_changed().connect(
+			[this](const Glib::RefPtr<Gio::File>& file,
+				   const Glib::RefPtr<Gio::File>& other, Gio::FileMonitorEvent event){
+				// a rename in the folder gives the new name as 'other'
+				std::string name;
+				if(event==Gio::FILE_MONITOR_EVENT_RENAMED && other)
+					name = other->get_basename();
+				else if(event==Gio::FILE_MONITOR_EVENT_MOVED_IN ||
+						event==Gio::FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+					name = file->get_basename();
+				if(name=="token.json"){		// even in the middle of a fetch
+					fetchState.reset("new token.json");
+					if(bFetching && !bTest)
+						bNewToken = true;	// setSlots() goes again after it
+					else
+						planFetch(2, "new token.json");
+					return;
+				}
+				if(bFetching && !bTest)
+					return;					// the answer is on its way
+				if(name=="events.txt" && bTest)
+					setCalendar();
+				else if(name=="events.bin" && !bTest){
+					CALENDAR c;
+					c.ok = true;
+					strcpy(c.text, "events.bin changed");
+					setCalendar(c);
+				}
+			});
+
+		// Show the events we had last time (see snapshot.h) so there is
+		// something on the screen from the first frame. 'today' comes from
+		// setDisplay() for the colours.
+		setDisplay(::time(nullptr));
+		if(mapEvents()){
+			bEventsShown = true;
+			refreshEvents(::time(nullptr));
+			showAge(::time(nullptr));
+		}
+
+		// Where each of the event sources works (see eventsource.h)
+		worker.setDir(CALDIR);
+		worker.setErrFile(responseFile);
+		gcal.setDir(CALDIR);
+		gcal.setZone(&zone);
+		ics.setDir(CALDIR);
+
+		// The calendar has timers of its own so it doesn't care how often
+		// we tick. Delay the first fetch for fifteen seconds.
+		planFetch(15, "startup");
 	}
 	virtual ~CLOCK(){}		// default clean-ups only
 
@@ -196,43 +381,133 @@ public:
 		for(int i=0; i<argc; ++i){
 			if(strcmp(argv[i], "-t")==0)
 				bTest = true;
+			else if(strcmp(argv[i], "-d")==0)
+				bDebug = true;
+			else if(strcmp(argv[i], "-l")==0){	// the old way for comparisons
+				bGlyphs = false;
+				digits.hide();
+				time.show();
+			}
+			else if(strcmp(argv[i], "-a")==0)	// for testing the tick
+				bAllocAbort = true;
+			else if(strcmp(argv[i], "-s")==0 && i+1<argc)	// stale minutes
+				staleAfter = atoi(argv[++i]);
+			else if(strcmp(argv[i], "-n")==0)	// no python, see gcal.h
+				source = &gcal;
+			else if(strcmp(argv[i], "-u")==0 && i+1<argc){	// a test server
+				source = &gcal;
+				gcal.setBase(argv[++i]);
+			}
+			else if(strcmp(argv[i], "-i")==0 && i+1<argc){	// an .ics file
+				source = &ics;
+				ics.setFile(argv[++i]);
+			}
+			else if(strcmp(argv[i], "-m")==0){	// low power, minutes only
+				bMinutes = true;
+				ticker.every(60);
+				digits.set_pattern("00:00");
+				time.fix("00:00");
+				oldDOW = 9;				// draw it now, not in a minute
+				setDisplay(::time(nullptr));
+			}
 		}
 	}
 
-	// Ticker at 1 per second
-	int Ticks{25};			// delay the first fetch for fifteen seconds
-	int Retries{0};			// limit the fast retries
+	// The calendar fetch and read timers
+	sigc::connection fetchTimer;	// when to run clock.py next
+	WORKER worker;					// clock.py kept running (see worker.h)
+	GCAL gcal;						// or do it ourselves (see gcal.h)
+	ICSSOURCE ics;					// or read an .ics file (see icssource.h)
+	EVENTSOURCE* source{&worker};	// the one we use
+	SNAPSHOT events;				// what they fetched (see snapshot.h)
+	EVENTSTORE store;				// and by time (see eventstore.h)
+	bool bEventsShown{false};		// the slots are from store, not errors
+	bool bFetching{false};	// between asking for the calendar and getting it
+	bool bNewToken{false};	// a token.json came while we were fetching
+	FETCHSTATE fetchState;	// backoff and the token breaker (fetchstate.h)
+	SCHEDULE schedule;		// when to fetch next (see schedule.h)
+	const char* planned{""};	// why the timer is set
+	char fetchText[80]{};	// how the last one went for the status line
 	char today[12]{};		// used to colour the lines for 'today'
 
 	// Update the time, day and date
 	int oldDOW{9};			// trigger the refresh of day oriented stuff
 
-	void setDisplay()
+	void setDisplay(time_t now)				// now is UTC from the ticker
 	{
-		char temp[30];
-		time_t now;
-		::time(&now);						// get UTC
-		tm *t = localtime(&now);			// convert to BST or whatever
-
-		sprintf(temp, "%02d:%02d:%02d", t->tm_hour, t->tm_min, t->tm_sec);
-		time.set_text(temp);
+		// This runs every second so no sprintf and nothing on the heap
+		char temp[12];
+		tm local;
+		tm *t = &local;
+		zone.local(now, t);					// convert to BST or whatever
+
+		FORMAT::time(temp, *t, !bMinutes);
+		if(bGlyphs)
+			digits.set_text(temp);
+		else
+			time.set(temp);
 
 		// the rest only changes if the day changes
 		if(t->tm_wday != oldDOW){
 			oldDOW = t->tm_wday;
 			const char* dow[] = { "Sunday",   "Monday", "Tuesday", "Wednesday",
 								  "Thursday", "Friday", "Saturday"  };
-			day.set_text(dow[t->tm_wday]);
+			day.set(dow[t->tm_wday]);
 
-			sprintf(temp, "%02d-%02d-%04d", t->tm_mday, t->tm_mon+1, 1900+t->tm_year);
-			date.set_text(temp);
+			FORMAT::date(temp, *t);
+			date.set(temp);
 
 			// Make a value to compare to the Google calendar stuff:
-			sprintf(today, "%04d-%02d-%02d", 1900+t->tm_year, t->tm_mon+1, t->tm_mday);
+			FORMAT::iso(today, *t);
+		}
+	}
+
+	// Arrange for the next fetch in 'seconds' and forget any earlier plan
+	void planFetch(int seconds, const char* reason)
+	{
+		// -d shows when and why on the status line and stdout
+		if(bDebug){
+			char text[160], at[12];
+			tm t;
+			zone.local(::time(nullptr)+seconds, &t);
+			FORMAT::time(at, t, true);
+			snprintf(text, sizeof(text), "%s  next %s %s (%d today)", fetchText,
+											at, reason, schedule.used);
+			status.set(text);
+			printf("fetch: next in %dS at %s %s\n", seconds, at, reason);
+			fflush(stdout);
+		}
+		planned = reason;
+		fetchTimer.disconnect();
+		fetchTimer = Glib::signal_timeout().connect_seconds(
+						[this]{ fetchCalendar(); return false; }, seconds);
+	}
+
+	// Ask the source (clock.py, gcal or the .ics) for the calendar, the
+	// answer comes back later on the main loop
+	void fetchCalendar()
+	{
+		++wakeups;
+		if(bTest){					// nothing to fetch, just read what is there
+			bFetching = true;		// and calWatch reads it again if it changes
+			setCalendar();
+			return;
 		}
+		if(!fetchState.start(planned))
+			return;					// the token is dead, wait for a new one
+		if(!schedule.spend(::time(nullptr), zone)){
+			fetchState.cancel("budget used");
+			planFetch(schedule.plan(::time(nullptr), nextEvent(), zone),
+													schedule.reason);
+			return;
+		}
+		bFetching = true;
+		source->fetch(60, [this](const CALENDAR& c){ setCalendar(c); });
 	}
 
-	// Update the calendar display
+	// Update the calendar display from events.txt (left by 'python clock.py'
+	// and read in -t test mode or when calWatch sees a new one, the worker
+	// sends its lines down the pipe)
 	void setCalendar()
 	{
 		// The events file has four sorts of entries, all day, timed and errors
@@ -243,115 +518,408 @@ public:
 		// Its stderr output are sent to response.edc so we can try
 		// and fail responsibly
 
-#define CALDIR	"/home/pi/calendar"
-		const char* eventsFile   = CALDIR "/events.txt";
-		const char* responseFile = CALDIR "/response.edc";
-
-		if(--Ticks==10 && !bTest){	// at 10 seconds to go run the calendar
-			if(fork()==0){			// go multi-threaded
-				chdir(CALDIR);
-				unlink(responseFile);
-				unlink(eventsFile);
-				char command[100];
-				sprintf(command, "python clock.py 2> %s", responseFile);
-				system(command);
-				exit(0);		// kill the forked thread
+		++wakeups;
+		bFetching = false;
+
+		int i=0;
+		CALENDAR::ERROR error = CALENDAR::NONE;
+		bEventsShown = false;				// these are text, see refreshEvents()
+		int fd = open(eventsFile, O_RDONLY | O_CLOEXEC);
+		if(fd>=0){
+			// any number in any order, only the next five are kept (nextn.h)
+			NEXTN next(5, ::time(nullptr));
+			std::vector<std::string> errors;
+			next.read(fd, zone, errors);
+			::close(fd);
+			for(size_t j=0; i<5 && j<errors.size(); ++j)
+				setEvent(i++, errors[j].c_str());
+			for(const auto& e : next.sorted())
+				if(i<5)
+					setEvent(i++, e.start, e.bAllDay, e.summary.c_str());
+		}
+		else{				// if the events file failed to open
+			error = CALENDAR::DATA;
+			FILE* f2 = fopen(responseFile, "r");
+			if(f2){
+				char buffer[200];
+				while(error!=CALENDAR::AUTH && fgets(buffer, sizeof(buffer), f2))
+					if(strstr(buffer, "Token has been expired")!=nullptr)
+						error = CALENDAR::AUTH;
+				fclose(f2);
 			}
 		}
-		if(Ticks<=0){
-			Ticks = bTest ? 60 : 60*60;		// reset for one hour
-			int i=0;
-			FILE* f = fopen(eventsFile, "r");
-			if(f){
-				char text1[200], text2[200];
-				for(; i<5 && fgets(text1, sizeof(text1), f); ++i){
-					// first process errors from clock.py
-					if(text1[0]=='*'){
-						int n = strlen(text1);				// tidy
-						if(text1[n-1]=='\n') text1[n-1] = 0;
-						slot[i].set_text(text1);
-					}
-					else{
-						// copy the date to the output
-						int j=0, k=0;
-						while(j<10) text2[k++] = text1[j++];
-
-						// is there a time?
-						if(text1[j++]!='T'){				// no
-							strcpy(text2+k, " all day  ");
-							k = strlen(text2);
-						}
-						else{
-							text2[k++] = ' ';
-							// copy the start time but discard the duration
-							while(j<19) text2[k++] = text1[j++];
-							text2[k++] = ' ';
-							// is it a '+' time or a 'Z' time?
-							if(text1[j]=='+') j += 7;
-							else              j += 2;
-						}
-						// copy the event text
-						while(text1[j] && text1[j]!='\n')
-							text2[k++] = text1[j++];
-						text2[k] = 0;
-
-						// check the date for today and if so use red text
-						const char* fg = "sval1";			// red
-						if(strncmp(text2, today, 10))
-							fg = "sval2";					// royal blue
-						slot[i].set_name(fg);
-						slot[i].set_text(text2);
-					}
-				}
-				Retries = 0;
-				fclose(f);
+		setSlots(i, error);
+	}
+
+	// The same from the EVENTSOURCE. When it worked the events are in
+	// events.bin, if not 'lines' says why but we keep showing the last good
+	// events (with their age) unless the user has to sort the token out.
+	void setCalendar(const CALENDAR& c)
+	{
+		++wakeups;
+		bFetching = false;
+		snprintf(fetchText, sizeof(fetchText), "%s", c.text);
+		status.set(c.text);
+
+		int i=0;
+		uint64_t before = events.hash();
+		bool ok = c.ok && mapEvents();
+		if(ok)
+			schedule.fetched(events.hash()!=before);
+		// it said ok but we can't read events.bin is a data problem
+		CALENDAR::ERROR error = ok ? CALENDAR::NONE
+							  : c.error!=CALENDAR::NONE ? c.error : CALENDAR::DATA;
+		bEventsShown = ok || (events.valid() && error!=CALENDAR::AUTH);
+		if(bEventsShown)
+			i = showEvents(::time(nullptr));
+		else
+			for(; i<5 && i<(int)c.lines.size() && error!=CALENDAR::AUTH; ++i)
+				setEvent(i, c.lines[i].c_str());
+		setSlots(i, error);
+		showAge(::time(nullptr));
+	}
+
+	// Map events.bin and index it by time
+	bool mapEvents()
+	{
+		bool ok = events.map(snapFile);
+		store.clear();
+		for(uint32_t i=0; i<events.count(); ++i)
+			store.add(events[i].start, events[i].end, i);
+		store.index();
+		return ok;
+	}
+
+	// Put the first five that haven't finished in the slots, returns how many
+	int showEvents(time_t now)
+	{
+		int i=0;
+		store.overlap(now, INT64_MAX, [&](const EVENTSTORE::INTERVAL& e){
+				setEvent(i++, events[e.index]);
+				return i<5; });
+		if(i==0)
+			setEvent(i++, "*no events");
+		return i;
+	}
+
+	// Once a minute drop what has finished, move the rest up and bring in
+	// the next from further down events.bin. After midnight setDisplay() has
+	// a new 'today' so this recolours them too. No fetching needed.
+	void refreshEvents(time_t now)
+	{
+		if(!bEventsShown) return;			// leave error messages alone
+		int i = showEvents(now);
+		for( ; i<5; ++i){
+			slot[i].name("sval2");
+			slot[i].set("**");
+		}
+	}
+
+	// Say how old the events are once they are older than staleAfter
+	void showAge(time_t now)
+	{
+		char text[40] = "";
+		long age = events.valid() ? long(now - events.modified()) : 0;
+		if(age>staleAfter*60){
+			if(age<2*3600)
+				snprintf(text, sizeof(text), "events %ld minutes old", age/60);
+			else if(age<2*86400)
+				snprintf(text, sizeof(text), "events %ld hours old", age/3600);
+			else
+				snprintf(text, sizeof(text), "events %ld days old", age/86400);
+		}
+		stale.set(text);
+	}
+
+	// Show an event from events.bin in slot i, read where it is in the file
+	void setEvent(int i, const SNAPEVENT& e)
+	{
+		setEvent(i, e.start, e.flags & SNAPEVENT::ALLDAY, events.text(e.summary),
+															e.calendar);
+	}
+
+	// Show one line of events.txt in slot i
+	void setEvent(int i, const char* text1)
+	{
+		char text2[200];
+		snprintf(text2, sizeof(text2), "%s", text1);
+		int n = strlen(text2);					// tidy
+		if(n && text2[n-1]=='\n') text2[n-1] = 0;
+
+		// the start is everything up to the first space (see rfc3339.h)
+		const char* space = strchr(text2, ' ');
+		RFC3339 start;
+		if(text2[0]=='*' || !space || !start.parse(text2, space-text2)){
+			slot[i].set(text2);					// errors from clock.py
+			return;
+		}
+		setEvent(i, start.local(zone), start.bDate, space+1);
+	}
+
+	// Show an event that starts at 'start' (UTC) in slot i in our local time
+	// coloured for its calendar
+	void setEvent(int i, int64_t start, bool bAllDay, const char* summary,
+															int calendar=0)
+	{
+		char text2[200], date[12], hms[12];
+		tm t;
+		zone.local(start, &t);
+		FORMAT::iso(date, t);
+		FORMAT::time(hms, t, true);
+		if(bAllDay)
+			snprintf(text2, sizeof(text2), "%s all day  %s", date, summary);
+		else
+			snprintf(text2, sizeof(text2), "%s %s %s", date, hms, summary);
+
+		// check the date for today and if so use red text
+		const char* fg = "sval1";			// red
+		if(strcmp(date, today))
+			fg = "sval2";					// royal blue
+		char cls[16] = "";					// and see the CSS for cal1...
+		if(calendar>0)
+			snprintf(cls, sizeof(cls), "cal%d", calendar);
+		slot[i].name(fg, cls);
+		slot[i].set(text2);
+	}
+
+	// The start of the first event that hasn't started yet, 0 for none
+	time_t nextEvent()
+	{
+		size_t i = store.next(::time(nullptr)+1);
+		return i<store.size() ? store[i].start : 0;
+	}
+
+	// Finish off the slots after 'i' lines and plan the next fetch
+	void setSlots(int i, CALENDAR::ERROR error)
+	{
+		// see schedule.h for how often and fetchstate.h for after a failure
+		int next = 60, wait = 0;
+		const char* reason = "test";
+		if(!bTest){
+			wait = fetchState.finished(error);
+			next = schedule.plan(::time(nullptr), nextEvent(), zone);
+			reason = schedule.reason;
+			if(wait>0){
+				next = wait;
+				reason = "backoff";
 			}
-			else{				// if the events file failed to open
-				// If it fails a couple of times retry but if it's stuck revert
-				// to the one hour schedule.
-				if(++Retries<4)
-					Ticks = 60*2;	// give it two minutes and then try again
-				FILE* f2 = fopen(responseFile, "r");
-				if(f2){
-					char buffer[200];
-					while(i==0 && fgets(buffer, sizeof(buffer), f2)!=nullptr){
-						if(strstr(buffer, "Token has been expired")!=nullptr){
-							slot[i].set_text("** Token refresh time **");
-							slot[i++].set_name("sval1");		// red
-							slot[i].set_text("   cd calendar");
-							slot[i++].set_name("sval1");		// red
-							slot[i].set_text("   rm token.json");
-							slot[i++].set_name("sval1");		// red
-							slot[i].set_text("   python clock.py");
-							slot[i++].set_name("sval1");		// red
-							slot[i].set_text("   wait for the browser and agree");
-							slot[i++].set_name("sval1");		// red
-						}
-					}
-					fclose(f2);
-				}
+			if(bNewToken){			// that fetch used the old token
+				bNewToken = false;
+				fetchState.reset("new token.json");
+				wait = 0;
+				next = 2;
+				reason = "new token.json";
 			}
-			if(i==0){						// response file failed too
-				slot[i].set_name("sval1");	// red
-				slot[i++].set_text("** Data failed to fetch **");
+		}
+		if(error==CALENDAR::AUTH && i==0){
+			slot[i].set("** Token refresh time **");
+			slot[i++].name("sval1");		// red
+			slot[i].set("   cd calendar");
+			slot[i++].name("sval1");		// red
+			slot[i].set("   rm token.json");
+			slot[i++].name("sval1");		// red
+			slot[i].set("   python clock.py");
+			slot[i++].name("sval1");		// red
+			slot[i].set("   wait for the browser and agree");
+			slot[i++].name("sval1");		// red
+		}
+		if(i==0){						// response file failed too
+			slot[i].name("sval1");	// red
+			slot[i++].set("** Data failed to fetch **");
+		}
+		for( ; i<5; ++i){			// blank the rest of the display
+			slot[i].name("sval2");
+			slot[i].set("**");
+		}
+		if(wait<0){					// nothing until reset() from calWatch
+			fetchTimer.disconnect();
+			if(bDebug){
+				char text[160];
+				snprintf(text, sizeof(text), "%s  waiting for a new token.json",
+																	fetchText);
+				status.set(text);
+			}
+			return;
+		}
+		planFetch(next, reason);
+	}
+
+	// Somebody moved the real clock (NTP at boot, date or a resume)
+	void clockChanged(const timespec& now)
+	{
+		if(bDebug){
+			printf("tick: the clock was set\n");
+			fflush(stdout);
+		}
+		jitter.reset();						// the old figures are meaningless
+		oldDOW = 9;							// force day, date and 'today'
+		setDisplay(now.tv_sec);
+		refreshEvents(now.tv_sec);
+
+		// The next fetch was planned in the old time so run it again now.
+		// Leave it alone if a fetch is already in flight.
+		if(!bFetching)
+			planFetch(2, "clock set");
+	}
+
+	void tick(const timespec& now)
+	{
+		long heap = allocations();
+		int dow = oldDOW;
+		++wakeups;
+		setDisplay(now.tv_sec);
+
+		// Measure how far into the second the new time went to the screen
+		timespec done;
+		clock_gettime(CLOCK_REALTIME, &done);
+		if(done.tv_sec==now.tv_sec)
+			jitter.add(TICKER::lateness(done));
+		else
+			jitter.add(1000);				// missed the whole second
+
+		bool bChanged = false;				// the minute changed a label
+		if(now.tv_sec%60==0){				// once a minute on the minute
+			long painted = DAMAGE::pixels;
+			refreshEvents(now.tv_sec);
+			showAge(now.tv_sec);
+			bChanged = DAMAGE::pixels!=painted;
+			// all the CPU we used, including GTK's painting, since last time
+			timespec cpu;
+			clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+			double ms = cpu.tv_sec*1e3 + cpu.tv_nsec/1e6;
+			if(bDebug && jitter.count){
+				printf("tick: %d ticks late by mean %.2fmS min %.2fmS max %.2fmS"
+					   " cpu %.2fmS per tick (%s) repainted %ld pixels/S"
+					   " %d layouts %d wakeups %d zone lookups"
+					   " %d ticks used the heap\n",
+					jitter.count, jitter.mean(), jitter.min, jitter.max,
+					(ms-cpuMark)/jitter.count, bGlyphs ? "glyphs" : "label",
+					DAMAGE::pixels/60, layouts, wakeups, zone.lookups,
+					allocTicks);
+				fflush(stdout);
 			}
-			for( ; i<5; ++i){			// blank the rest of the display
-				slot[i].set_name("sval2");
-				slot[i].set_text("**");
+			cpuMark = ms;
+			DAMAGE::pixels = 0;
+			layouts = 0;
+			wakeups = 0;
+			jitter.reset();
+		}
+
+		// Once we are going a tick shouldn't need the heap at all (see
+		// alloc.h), the minute's work included. At midnight, or when the
+		// minute changed an event's text or colour, GTK restyles and lays
+		// out the label and that is allowed to.
+		++ticks;
+		if(ticks>2 && allocations()!=heap && dow==oldDOW && !bChanged){
+			++allocTicks;
+			if(bAllocAbort){
+				fprintf(stderr, "tick: %ld heap allocations in a steady tick\n",
+													allocations()-heap);
+				abort();
 			}
 		}
 	}
-	bool tick()
+
+	// The 'clock -b render' benchmark: move our widgets into an offscreen
+	// window and time drawing 'frames' seconds worth of clock into an image,
+	// once with glyphs and once with the label. GTK normally does all three
+	// steps in one go from its frame clock so we do them by hand:
+	//	style	ask every widget for its CSS so anything invalid is worked out
+	//	layout	check_resize() does any size negotiation that is queued
+	//	paint	draw the whole window into a Cairo image surface
+	int benchRender(int frames)
 	{
-		setDisplay();
-		setCalendar();
-		return true;
+		ticker.stop();						// nothing else gets a look in
+		fetchTimer.disconnect();
+		remove();							// take 'fixed' out of the window
+		Gtk::OffscreenWindow off;
+		off.add(fixed);
+		off.show();
+
+		auto surface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32,
+															1440, 900);
+		auto cr = Cairo::Context::create(surface);
+		Gtk::Widget* widgets[] = { &time, &digits, &day, &date, &slot[0],
+							&slot[1], &slot[2], &slot[3], &slot[4], &fixed };
+
+		auto ms = []{
+			timespec t;
+			clock_gettime(CLOCK_MONOTONIC, &t);
+			return t.tv_sec*1e3 + t.tv_nsec/1e6;
+		};
+		auto show = [frames](const char* what, std::vector<double>& v){
+			std::sort(v.begin(), v.end());
+			printf(" %s p50 %.3fmS p99 %.3fmS", what, v[frames/2], v[frames*99/100]);
+		};
+
+		for(int mode=0; mode<2; ++mode){
+			bGlyphs = mode==0;
+			digits.set_visible(bGlyphs);
+			time.set_visible(!bGlyphs);
+			oldDOW = 9;
+			time_t start = ::time(nullptr);
+			setDisplay(start-1);			// settle it down first
+			off.check_resize();
+			off.draw(cr);
+
+			std::vector<double> style, layout, paint;
+			for(int i=0; i<frames; ++i){
+				setDisplay(start+i);
+				double t0 = ms();
+				for(auto w : widgets)
+					w->get_style_context()->get_color(w->get_state_flags());
+				double t1 = ms();
+				off.check_resize();
+				double t2 = ms();
+				off.draw(cr);
+				surface->flush();
+				double t3 = ms();
+				style.push_back(t1-t0);
+				layout.push_back(t2-t1);
+				paint.push_back(t3-t2);
+			}
+			printf("render: %-6s", bGlyphs ? "glyphs" : "label");
+			show("style", style);
+			show("layout", layout);
+			show("paint", paint);
+			printf("\n");
+		}
+		off.remove();
+		return 0;
 	}
 };
 
+// This has to be in here to see CLOCK
+int benchRender()
+{
+	int argc = 1;
+	char name[] = "clock";
+	char* args[] = { name, nullptr };
+	char** argv = args;
+	if(!gtk_init_check(&argc, &argv)){
+		printf("render: no display, try xvfb-run or GDK_BACKEND=broadway\n");
+		return 1;
+	}
+	Gtk::Main kit(argc, argv);				// get gtkmm going without an app
+	auto app = Gtk::Application::create("clock.bench",
+										Gio::APPLICATION_NON_UNIQUE);
+	CLOCK clock(app);
+	return clock.benchRender(600);
+}
+
 
 int main(int argc, char *argv[])
 {
+	// If clock.py dies we don't want writing to its pipe to kill us too
+	signal(SIGPIPE, SIG_IGN);
+
+	// The benchmarks don't want a window so catch them before gtkmm does
+	if(argc>1 && strcmp(argv[1], "-b")==0)
+		return bench(argc-1, argv+1);
+	// and so does printing an events.bin
+	if(argc>1 && strcmp(argv[1], "-x")==0)
+		return SNAPSHOT::dump(argc>2 ? argv[2] : snapFile);
+
 	// Command line arguments are a pain under gtkmm so I will try to explain.
 	// We add the APPLICATION_HANDLES_COMMAND_LINE flag so we get sent the args
 	// then we hook up a receiver callback in CLOCK to handle them
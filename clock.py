@@ -1,8 +1,18 @@
 from __future__ import print_function
 
+import time
+started = time.monotonic()      # before the slow imports, for --bench
+
+import concurrent.futures
 import datetime
+import heapq
+import itertools
+import json
 import os.path
 import os
+import struct
+import sys
+import traceback
 
 from google.auth.transport.requests import Request
 from google.oauth2.credentials import Credentials
@@ -14,10 +24,8 @@ from googleapiclient.errors import HttpError
 SCOPES = ['https://www.googleapis.com/auth/calendar.readonly']
 
 
-def main():
-    """Shows basic usage of the Google Calendar API.
-    Prints the start and name of the next 10 events on the user's calendar.
-    """
+def credentials(interactive=True):
+    """Load token.json, refreshing it or asking the user if we have to."""
     creds = None
     # The file token.json stores the user's access and refresh tokens, and is
     # created automatically when the authorization flow completes for the first
@@ -28,50 +36,302 @@ def main():
     if not creds or not creds.valid:
         if creds and creds.expired and creds.refresh_token:
             creds.refresh(Request())
-        else:
+        elif interactive:
             flow = InstalledAppFlow.from_client_secrets_file(
                 'credentials.json', SCOPES)
             creds = flow.run_local_server(port=0)
-        # Save the credentials for the next run
-        with open('token.json', 'w') as token:
+        else:
+            # the worker has no browser so the user has to do it by hand
+            raise RuntimeError('Token has been expired or revoked')
+        # Save the credentials for the next run, renamed into place so
+        # CLOCK (which watches for it) never sees half of it
+        with open('token.json.new', 'w') as token:
             token.write(creds.to_json())
+        os.replace('token.json.new', 'token.json')
+    return creds
 
-    # delete and restart the output file
-    if os.path.exists('events.txt'):
-        os.remove('events.txt')
-    f = open('events.txt', 'w')
 
+SYNC = 'sync.json'      # the sync tokens and our copy of each calendar
+CALENDARS = 'calendars.txt'     # which calendars, just 'primary' without it
+FIELDS = 'nextPageToken,nextSyncToken,items(id,status,start,end,summary)'
+AHEAD = 25              # events handed over, CLOCK shows 5 and drops
+                        # them itself as they finish
+state = None            # what is in SYNC, kept between worker fetches
+
+
+def calendars():
+    """The calendar ids from calendars.txt, one a line and # lines are
+    comments (ids like en.uk#holiday@group.v.calendar.google.com have a # in
+    them so only at the start). The order is the number each one gets in
+    events.bin which CLOCK uses for its colour, label.cal1 and so on."""
     try:
-        service = build('calendar', 'v3', credentials=creds)
-
-        # Call the Calendar API
-        now = datetime.datetime.utcnow().isoformat() + 'Z'  # 'Z' indicates UTC time
-        print('Getting the upcoming 10 events')
-        events_result = service.events().list(calendarId='primary', timeMin=now,
-                                              maxResults=10, singleEvents=True,
-                                              orderBy='startTime').execute()
-        events = events_result.get('items', [])
-
-        if not events:
-           fwrite('*no events\n');
+        with open(CALENDARS) as f:
+            ids = [line.strip() for line in f]
+    except OSError:
+        ids = []
+    return [i for i in ids if i and not i.startswith('#')] or ['primary']
+
+
+def connect(creds):
+    """A service object for each calendar as (number, id, service). Each has
+    its own HTTP connection (httplib2 can't be shared between threads) so
+    the calendars can all be fetched at once."""
+    return [(number, calendar, build('calendar', 'v3', credentials=creds))
+            for number, calendar in enumerate(calendars())]
+
+
+def when(time):
+    """An event's start or end as an aware datetime for sorting and comparing.
+    All day events only have a date which means midnight local time."""
+    if 'dateTime' in time:
+        return datetime.datetime.fromisoformat(time['dateTime'].replace('Z', '+00:00'))
+    return datetime.datetime.fromisoformat(time['date']).astimezone()
+
+
+def load():
+    """Read SYNC the first time, it has a sync token and events for each
+    calendar id. One from before there were several calendars is primary's."""
+    global state
+    if state is None and os.path.exists(SYNC):
+        try:
+            with open(SYNC) as f:
+                state = json.load(f)
+        except ValueError:
+            state = None
+    if state is not None and 'events' in state:
+        state = {'primary': state}
+    if state is None:
+        state = {}
+
+
+def save():
+    """Write SYNC somewhere else first so a crash never leaves half a file."""
+    with open(SYNC + '.new', 'w') as f:
+        json.dump(state, f)
+    os.replace(SYNC + '.new', SYNC)
+
+
+def sync(service, calendar='primary', log=print):
+    """Bring our copy of one calendar up to date and return its events.
+    The first time (or if Google has forgotten our sync token and says 410
+    Gone) we list everything from yesterday on, after that we only ask for
+    what has changed since and apply it, which is usually nothing. Each
+    calendar only touches its own part of state so they can run together."""
+    mine = state.get(calendar)
+    if mine is None or not mine.get('token'):
+        mine = {'events': {}}
+    full = 'token' not in mine
+    since = datetime.datetime.utcnow() - datetime.timedelta(days=1)
+    page = None
+    while True:
+        if full:
+            request = service.events().list(calendarId=calendar, singleEvents=True,
+                                            timeMin=since.isoformat() + 'Z',
+                                            pageToken=page, fields=FIELDS)
         else:
-           # Prints the start and name of the next 10 events
-           for event in events:
-               start = event['start'].get('dateTime', event['start'].get('date'))
-               print(start, event['summary'])
-               f.write(start)
-               f.write(' ')
-               f.write(event['summary'])
-               f.write('\n')
+            request = service.events().list(calendarId=calendar, singleEvents=True,
+                                            syncToken=mine['token'],
+                                            pageToken=page, fields=FIELDS)
+        try:
+            result = request.execute()
+        except HttpError as error:
+            if error.resp.status == 410 and not full:
+                log('Sync token expired, listing everything in', calendar)
+                mine = {'events': {}}
+                full = True
+                page = None
+                continue
+            raise
+        for event in result.get('items', []):
+            if event.get('status') == 'cancelled':
+                mine['events'].pop(event['id'], None)
+            else:
+                mine['events'][event['id']] = {
+                    'id': event['id'], 'start': event['start'], 'end': event['end'],
+                    'summary': event.get('summary', '')}
+        page = result.get('nextPageToken')
+        if not page:
+            mine['token'] = result.get('nextSyncToken')
+            break
+    # forget the ones that are over so the file doesn't grow for ever
+    gone = since.replace(tzinfo=datetime.timezone.utc)
+    mine['events'] = {k: e for k, e in mine['events'].items()
+                      if when(e['end']) > gone}
+    log('%s sync of %s, %d events known' % ('Full' if full else 'Incremental',
+                                            calendar, len(mine['events'])))
+    state[calendar] = mine
+    return list(mine['events'].values())
+
 
+def upcoming(services, log=print):
+    """The next AHEAD events that haven't finished yet from our synced copies
+    of all the calendars. They are fetched at the same time, one thread each,
+    so it takes as long as the slowest one not all of them added up. A shared
+    calendar can know thousands of events so each one's first AHEAD are
+    picked with heapq.nsmallest (a heap of AHEAD, not a sort of the lot, like
+    NEXTN in nextn.h) and those lists, already in order, are merged
+    (heapq.merge keeps a heap of the first of each)."""
+    log('Getting the upcoming %d events' % AHEAD)
+    load()
+    now = datetime.datetime.now(datetime.timezone.utc)
+    start = lambda e: when(e['start'])
+
+    def one(number, calendar, service):
+        events = heapq.nsmallest(AHEAD, (e for e in sync(service, calendar, log)
+                                          if when(e['end']) > now), key=start)
+        return [dict(e, calendar=number) for e in events]
+
+    with concurrent.futures.ThreadPoolExecutor(len(services)) as pool:
+        lists = list(pool.map(lambda s: one(*s), services))
+    save()
+    return list(itertools.islice(heapq.merge(*lists, key=start), AHEAD))
+
+
+def lines(events, log=print):
+    """The events as events.txt has them, start and summary."""
+    if not events:
+        return ['*no events']
+    out = []
+    for event in events:
+        start = event['start'].get('dateTime', event['start'].get('date'))
+        log(start, event['summary'])
+        out.append(start + ' ' + event['summary'])
+    return out
+
+
+def snapshot(events, path='events.bin'):
+    """Write the events in the binary form CLOCK maps (see snapshot.h) unless
+    the file already holds exactly that. Returns True if it was written."""
+    strings = bytearray(b'\0')         # offset 0 is ''
+    offsets = {'': 0}
+
+    def intern(text):
+        if text not in offsets:
+            offsets[text] = len(strings)
+            strings.extend(text.encode('utf-8') + b'\0')
+        return offsets[text]
+
+    records = bytearray()
+    for event in events:
+        start = event['start'].get('dateTime', event['start'].get('date'))
+        records += struct.pack('<qqIIIHH', int(when(event['start']).timestamp()),
+                               int(when(event['end']).timestamp()), intern(start),
+                               intern(event['summary']), intern(event.get('id', '')),
+                               0 if 'dateTime' in event['start'] else 1,
+                               event.get('calendar', 0))
+    head = struct.pack('<4sHHHHIII8x', b'PCLK', 1, 32, 32, 0, len(events),
+                       32 + len(records), len(strings))
+    data = head + records + strings
+    if os.path.exists(path):
+        with open(path, 'rb') as f:
+            if f.read() == data:
+                os.utime(path)          # still good as of now
+                return False            # save the SD card
+    with open(path + '.new', 'wb') as f:
+        f.write(data)
+        f.flush()
+        os.fsync(f.fileno())
+    os.replace(path + '.new', path)
+    return True
+
+
+def fetch(services, log=print):
+    """Write the start and name of the next AHEAD events to events.txt and
+    events.bin."""
+    # write a new file and rename it over the old one when it is complete,
+    # CLOCK reads it as soon as it sees the rename
+    ok = True
+    try:
+        events = upcoming(services, log)
+        text = lines(events, log)
+        snapshot(events)
     except HttpError as error:
-        print('An error occurred: %s' % error)
-        f.write('* An HTTP error occurred *\n')
-        f.write(error)
-        f.write('\n')
+        log('An error occurred: %s' % error)
+        text = ['* An HTTP error occurred *', str(error)]
+        ok = False
+    with open('events.txt.new', 'w') as f:
+        for line in text:
+            f.write(line + '\n')
+    os.replace('events.txt.new', 'events.txt')
+    return ok
+
+
+def main():
+    """Run once by hand (or from cron). Gets a token.json, going through the
+    browser if there isn't a good one, syncs every calendar in calendars.txt
+    and writes the next AHEAD events of them all to events.bin and
+    events.txt, printing each as it goes."""
+    creds = credentials()
+    fetch(connect(creds))
+
+
+def worker():
+    """Stay running for CLOCK and fetch each time it writes 'fetch' to stdin.
+    The credentials and services are kept between fetches so after the first
+    one a fetch is just the HTTP round trip. The events go in events.bin
+    (only written if they have changed) and stdout says how it went, with the
+    error lines first if Google said no
+        event * An HTTP error occurred *
+        done ok|error|token seconds
+    'token' means the user has to make a new token.json by hand. Any other
+    trouble goes to stderr which CLOCK sends to response.edc.
+    """
+    sys.stdout.reconfigure(encoding='utf-8', errors='replace')
+    creds = services = None
+    quiet = lambda *args: None          # stdout is for answers only
+    put = lambda line: print('event', line.replace('\n', ' '))
+    for line in sys.stdin:
+        if line.strip() != 'fetch':
+            continue
+        start = time.monotonic()
+        result = 'error'
+        try:
+            if not creds or not creds.valid:
+                creds = credentials(interactive=False)
+                services = None
+            if services is None:
+                services = connect(creds)
+            snapshot(upcoming(services, quiet))
+            result = 'ok'
+        except HttpError as error:
+            put('* An HTTP error occurred *')
+            put(str(error))
+        except Exception as error:
+            traceback.print_exc()
+            sys.stderr.flush()
+            creds = services = None     # start again from token.json
+            if 'Token has been expired' in str(error):
+                result = 'token'
+        print('done', result, '%.2f' % (time.monotonic() - start), flush=True)
+
 
-    f.close()
+def bench(count=5):
+    """Time a cold fetch (imports, credentials, build) against warm ones."""
+    imported = time.monotonic()
+    creds = credentials()
+    authorised = time.monotonic()
+    services = connect(creds)
+    built = time.monotonic()
+    quiet = lambda *args: None
+    upcoming(services, quiet)
+    cold = time.monotonic()
+    print('cold: imports %.2fS credentials %.2fS build %.2fS fetch %.2fS'
+          ' total %.2fS' % (imported - started, authorised - imported,
+                            built - authorised, cold - built, cold - started))
+    warm = []
+    for i in range(count):
+        t = time.monotonic()
+        upcoming(services, quiet)
+        warm.append(time.monotonic() - t)
+    warm.sort()
+    print('warm: %d fetches best %.2fS median %.2fS worst %.2fS'
+          % (count, warm[0], warm[len(warm)//2], warm[-1]))
 
 
 if __name__ == '__main__':
-    main()
\ No newline at end of file
+    if '--worker' in sys.argv:
+        worker()
+    elif '--bench' in sys.argv:
+        bench()
+    else:
+        main()
@@ -0,0 +1,43 @@
+//==============================================================================
+// eventsource.h	Somewhere the events come from
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// CLOCK doesn't care how the calendar is got, only that it asks for it and
+// later is told how it went. So each way of getting it is an EVENTSOURCE
+//		WORKER		clock.py kept running down a pipe (worker.h)
+//		GCAL		Google's API done ourselves (gcal.h, -n)
+//		ICSSOURCE	an .ics file on the disk, no network at all (icssource.h, -i)
+// and CLOCK keeps a pointer to the one in use. fetch() mustn't hold up the
+// tick: it starts the work and returns, then done() is called once on the
+// main loop with the CALENDAR. If it worked the batch of events is in
+// events.bin in the directory it was given and CLOCK reads it from there as
+// it always has, so a new source only has to write one of those.
+//
+//==============================================================================
+
+#pragma once
+
+#include "calendar.h"
+#include <string>
+#include <functional>
+
+class EVENTSOURCE {
+protected:
+	std::string dir;						// where events.bin goes
+
+public:
+	virtual ~EVENTSOURCE() = default;
+
+	void setDir(const char* d)	{ dir = d; }
+
+	// Still working on the last fetch()
+	virtual bool busy() const = 0;
+
+	// Start getting the events and call done() from the main loop when it has
+	// them or has given up, always once and never from inside fetch()'s call
+	// unless it couldn't even start
+	virtual void fetch(int timeout, std::function<void(const CALENDAR&)> done) = 0;
+};
@@ -0,0 +1,154 @@
+//==============================================================================
+// eventstore.h	The events by time so we can ask what is on when
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// The screen used to be the only record of the events: five labels of text.
+// EVENTSTORE keeps each one's start and end (UTC seconds) and which record of
+// events.bin it is, sorted by start, and answers
+//	now(t)			what is happening at t
+//	next(t, n)		the next n to start at or after t
+//	overlap(a, b)	everything that is on at some time in [a,b)
+// The last one is the interesting bit. Sorted by start we can find where to
+// stop with a binary search but not where to begin as a long event that
+// started ages ago may still be going. So the sorted array is also read as a
+// binary tree (the 'implicit interval tree' from Heng Li's cgranges): the
+// item at i is a node at level 'the number of 1s at the bottom of i', so all
+// the even ones are leaves, 1,5,9... are one up, 3,11,19... two up and so on
+// and the middle one is the root. Each node also keeps the latest end under
+// it (maxEnd) so whole branches that finish before 'a' are never looked at.
+// There are no pointers and nothing to rebalance, add() them all and index().
+//
+// Queries call back with each match in start order and stop if it returns
+// false. They use no heap so the tick can call them ('clock -b store' times
+// them with 100,000 events).
+//
+//==============================================================================
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+class EVENTSTORE {
+public:
+	struct INTERVAL {
+		int64_t		start;					// UTC seconds
+		int64_t		end;					// just after it finishes
+		uint32_t	index;					// which event, eg: in events.bin
+	};
+
+protected:
+	std::vector<INTERVAL> items;			// sorted by start
+	std::vector<int64_t>  maxEnd;			// the latest end under each node
+	int		levels{-1};						// the root's level, -1 if empty
+
+public:
+	void clear()		{ items.clear(); maxEnd.clear(); levels = -1; }
+	size_t size() const	{ return items.size(); }
+	const INTERVAL& operator[](size_t i) const { return items[i]; }
+
+	// Put one in, call index() when they are all there. A zero length event
+	// is made a second long so it happens at all.
+	void add(int64_t start, int64_t end, uint32_t index)
+	{
+		items.push_back(INTERVAL{start, std::max(end, start+1), index});
+	}
+
+	// Sort them and fill in maxEnd from the leaves up
+	void index()
+	{
+		std::stable_sort(items.begin(), items.end(),
+				[](const INTERVAL& a, const INTERVAL& b){ return a.start<b.start; });
+		int64_t n = int64_t(items.size());
+		maxEnd.resize(n);
+		levels = -1;
+		if(n==0) return;
+
+		// the last node of a level may have no right branch (n isn't a power
+		// of two less one) so keep the latest end of what would be there
+		int64_t lastI = 0, last = 0;
+		for(int64_t i=0; i<n; i+=2){
+			lastI = i;
+			last = maxEnd[i] = items[i].end;
+		}
+		int k = 1;
+		for( ; (int64_t(1)<<k)<=n; ++k){
+			int64_t x = int64_t(1)<<(k-1), step = x<<2;
+			for(int64_t i=(x<<1)-1; i<n; i+=step){
+				int64_t left  = maxEnd[i-x];
+				int64_t right = i+x<n ? maxEnd[i+x] : last;
+				maxEnd[i] = std::max(items[i].end, std::max(left, right));
+			}
+			lastI = (lastI>>k & 1) ? lastI-x : lastI+x;
+			if(lastI<n && maxEnd[lastI]>last)
+				last = maxEnd[lastI];
+		}
+		levels = k-1;
+	}
+
+	// Everything on at some time in [a,b), f(const INTERVAL&) returns false
+	// to stop. Returns how many were passed to f.
+	template<class F> int overlap(int64_t a, int64_t b, F f) const
+	{
+		struct STEP { int64_t x; int k; bool bRight; } stack[64];
+		int64_t n = int64_t(items.size());
+		int top = 0, found = 0;
+		if(levels<0) return 0;
+		stack[top++] = STEP{(int64_t(1)<<levels)-1, levels, false};
+		while(top){
+			STEP s = stack[--top];
+			if(s.k<=3){						// a small branch, just look
+				int64_t i = s.x >> s.k << s.k;
+				int64_t end = std::min(i + (int64_t(2)<<s.k) - 1, n);
+				for( ; i<end && items[i].start<b; ++i)
+					if(a<items[i].end){
+						++found;
+						if(!f(items[i])) return found;
+					}
+			}
+			else if(!s.bRight){				// left first, then come back
+				int64_t y = s.x - (int64_t(1)<<(s.k-1));
+				stack[top++] = STEP{s.x, s.k, true};
+				if(y>=n || maxEnd[y]>a)
+					stack[top++] = STEP{y, s.k-1, false};
+			}
+			else if(s.x<n && items[s.x].start<b){	// this one, then right
+				if(a<items[s.x].end){
+					++found;
+					if(!f(items[s.x])) return found;
+				}
+				stack[top++] = STEP{s.x + (int64_t(1)<<(s.k-1)), s.k-1, false};
+			}
+		}
+		return found;
+	}
+
+	// What is happening at t
+	template<class F> int now(int64_t t, F f) const
+	{
+		return overlap(t, t+1, f);
+	}
+
+	// The first of those starting at or after t, there are size()-first of
+	// them in order from there
+	size_t next(int64_t t) const
+	{
+		return std::lower_bound(items.begin(), items.end(), t,
+				[](const INTERVAL& e, int64_t t){ return e.start<t; }) - items.begin();
+	}
+
+	// The next n starting at or after t
+	template<class F> int next(int64_t t, int n, F f) const
+	{
+		int found = 0;
+		for(size_t i=next(t); i<items.size() && found<n; ++i){
+			++found;
+			if(!f(items[i])) break;
+		}
+		return found;
+	}
+};
@@ -0,0 +1,141 @@
+//==============================================================================
+// fetchstate.h	What to do when a fetch goes wrong
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// The old rule was 'retry in two minutes three times and then go back to
+// hourly' whatever went wrong. But a dead token won't get better on its own
+// and hammering Google every two minutes with it is pointless while a network
+// outage may well last longer than six minutes. So each failure is sorted
+// (see CALENDAR::ERROR) and
+//	NETWORK, WORKER and DATA	are worth another go so we back off: one
+//			minute, two, four... up to an hour, each with some randomness
+//			(jitter) so lots of clocks after a power cut don't all go at once
+//	AUTH	opens the breaker and there are no more fetches until somebody
+//			makes a new token.json (CLOCK watches for it) or presses Refresh
+//
+//			IDLE --start--> FETCHING --ok--> IDLE
+//						FETCHING --NETWORK/WORKER/DATA--> BACKOFF --start--> ...
+//						FETCHING --AUTH--> BROKEN --reset--> IDLE
+//
+// Every change of state is logged. The time and the random numbers come from
+// 'clock' and 'seed' so a test can drive it without waiting.
+//
+//==============================================================================
+
+#pragma once
+
+#include "calendar.h"
+#include <time.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <functional>
+#include <algorithm>
+
+class FETCHSTATE {
+public:
+	enum STATE { IDLE, FETCHING, BACKOFF, BROKEN };
+
+	int		first{60};						// the first retry, seconds
+	int		cap{3600};						// the longest
+	std::function<time_t()> clock{ []{ return ::time(nullptr); } };
+	std::function<void(const char*)> log{ [](const char* text){
+				printf("fetch: %s\n", text);
+				fflush(stdout);
+			} };
+	unsigned seed{unsigned(::time(nullptr))};
+
+protected:
+	STATE	state{IDLE};
+	int		failures{0};					// in a row
+	CALENDAR::ERROR last{CALENDAR::NONE};
+	time_t	since{0};						// when we got to this state
+
+public:
+	STATE now() const		{ return state; }
+	int	failed() const		{ return failures; }
+	CALENDAR::ERROR error() const { return last; }
+
+	// About to fetch, false if the breaker is open and we mustn't
+	bool start(const char* why)
+	{
+		if(state==BROKEN){
+			char text[120];
+			snprintf(text, sizeof(text), "not fetching for %s, waiting for"
+											" a new token.json", why);
+			log(text);
+			return false;
+		}
+		move(FETCHING, why);
+		return true;
+	}
+
+	// The fetch finished. Returns the seconds to wait before trying again,
+	// 0 for 'use the schedule' and -1 for 'not until the token changes'.
+	int finished(CALENDAR::ERROR e)
+	{
+		last = e;
+		if(e==CALENDAR::NONE){
+			failures = 0;
+			move(IDLE, "ok");
+			return 0;
+		}
+		if(e==CALENDAR::AUTH){
+			++failures;
+			move(BROKEN, "the token needs renewing");
+			return -1;
+		}
+		// double each time up to the cap and then take a random 50-100%
+		int wait = first << std::min(failures, 16);
+		wait = std::min(wait, cap);
+		wait = wait/2 + int(rand_r(&seed) % unsigned(wait/2 + 1));
+		++failures;
+		char text[120];
+		snprintf(text, sizeof(text), "%s failure %d, retry in %dS", name(e),
+															failures, wait);
+		move(BACKOFF, text);
+		return wait;
+	}
+
+	// start() was called but we didn't fetch after all
+	void cancel(const char* why)
+	{
+		if(state==FETCHING)
+			move(IDLE, why);
+	}
+
+	// A new token.json or a person pressing Refresh, close the breaker and
+	// forget the backoff
+	void reset(const char* why)
+	{
+		failures = 0;
+		if(state==BROKEN || state==BACKOFF)
+			move(IDLE, why);
+	}
+
+	static const char* name(STATE s)
+	{
+		static const char* names[] = { "IDLE", "FETCHING", "BACKOFF", "BROKEN" };
+		return names[s];
+	}
+	static const char* name(CALENDAR::ERROR e)
+	{
+		static const char* names[] = { "no", "network", "auth", "worker", "data" };
+		return names[e];
+	}
+
+protected:
+	void move(STATE to, const char* why)
+	{
+		if(to==state) return;
+		char text[200];
+		time_t t = clock();
+		snprintf(text, sizeof(text), "%s -> %s after %lds: %s", name(state),
+								name(to), long(since ? t-since : 0), why);
+		state = to;
+		since = t;
+		log(text);
+	}
+};
@@ -0,0 +1,68 @@
+//==============================================================================
+// format.h		Turn times into text without sprintf
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// sprintf() has to parse its format string every time and can end up in the
+// locale code. Our numbers are all two digit pairs so a table of "00".."99"
+// does the job with a few byte copies and never touches the heap.
+//
+//==============================================================================
+
+#pragma once
+
+#include <time.h>
+
+struct FORMAT {
+	// "00" to "99" in one long string, pair n is at pairs[2*n]
+	inline static const char pairs[] =
+		"00010203040506070809101112131415161718192021222324252627282930313233"
+		"34353637383940414243444546474849505152535455565758596061626364656667"
+		"6869707172737475767778798081828384858687888990919293949596979899";
+
+	static char* two(char* p, int n)
+	{
+		p[0] = pairs[2*n];
+		p[1] = pairs[2*n+1];
+		return p+2;
+	}
+
+	// HH:MM:SS or HH:MM into out[9]
+	static void time(char* out, const tm& t, bool seconds)
+	{
+		char* p = two(out, t.tm_hour);
+		*p++ = ':';
+		p = two(p, t.tm_min);
+		if(seconds){
+			*p++ = ':';
+			p = two(p, t.tm_sec);
+		}
+		*p = 0;
+	}
+	// DD-MM-YYYY for the display into out[11]
+	static void date(char* out, const tm& t)
+	{
+		int y = 1900 + t.tm_year;
+		char* p = two(out, t.tm_mday);
+		*p++ = '-';
+		p = two(p, t.tm_mon+1);
+		*p++ = '-';
+		p = two(p, y/100%100);
+		p = two(p, y%100);
+		*p = 0;
+	}
+	// YYYY-MM-DD like the calendar uses into out[11]
+	static void iso(char* out, const tm& t)
+	{
+		int y = 1900 + t.tm_year;
+		char* p = two(out, y/100%100);
+		p = two(p, y%100);
+		*p++ = '-';
+		p = two(p, t.tm_mon+1);
+		*p++ = '-';
+		p = two(p, t.tm_mday);
+		*p = 0;
+	}
+};
@@ -0,0 +1,89 @@
+//==============================================================================
+// fuzz/rfc3339.cpp	Throw rubbish at RFC3339::parse()
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// With clang and libFuzzer ('make fuzz' then ./fuzz/rfc3339) it runs for as
+// long as you let it. Built with -DFUZZ_STANDALONE it needs no clang and
+// just tries a few million random changes to some real time stamps, or the
+// files named on the command line.
+//
+// Besides not crashing, anything it accepts must come out the same when
+// written back in the plain form and read again.
+//
+//==============================================================================
+
+#include "../rfc3339.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	RFC3339 t;
+	if(!t.parse((const char*)data, size))
+		return 0;
+
+	// write it back with the same offset and read that
+	int64_t wall = t.utc + t.offset;
+	int64_t day = wall>=0 ? wall/86400 : (wall-86399)/86400;
+	int secs = int(wall - day*86400);
+	int y, m, d;
+	ZONE::civil(day, y, m, d);
+	char text[64];
+	int n;
+	if(t.bDate)
+		n = snprintf(text, sizeof(text), "%04d-%02d-%02d", y, m, d);
+	else
+		n = snprintf(text, sizeof(text), "%04d-%02d-%02dT%02d:%02d:%02d%c%02d:%02d",
+				y, m, d, secs/3600, secs/60%60, secs%60, t.offset<0 ? '-' : '+',
+				abs(t.offset)/3600, abs(t.offset)/60%60);
+	RFC3339 again;
+	// (second 60 on the last day of 9999 rolls into a year we can't write)
+	if(y>9999) return 0;
+	if(!again.parse(text, n) || again.utc!=t.utc || again.bDate!=t.bDate){
+		fprintf(stderr, "rfc3339: %.*s read back as %s\n", int(size), data, text);
+		abort();
+	}
+	return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+int main(int argc, char* argv[])
+{
+	if(argc>1){								// replay some files
+		for(int i=1; i<argc; ++i){
+			FILE* f = fopen(argv[i], "rb");
+			if(!f) continue;
+			uint8_t buffer[4096];
+			size_t n = fread(buffer, 1, sizeof(buffer), f);
+			fclose(f);
+			LLVMFuzzerTestOneInput(buffer, n);
+		}
+		return 0;
+	}
+	static const char* seeds[] = { "2022-10-13", "2022-10-13T12:00:00+01:00",
+		"2022-11-01T21:00:00Z", "2022-10-13T12:00:00.500-04:30",
+		"2024-02-29t23:59:60z", "2022-10-13 12:00:00.123456789" };
+	static const char pick[] = "0123456789-:+.TtZz \xff";
+	srand(1);
+	for(long i=0; i<5000000; ++i){
+		char s[48];
+		size_t n = strlen(seeds[i%6]);
+		memcpy(s, seeds[i%6], n);
+		for(int k=rand()%4; k>=0; --k){		// a few changes
+			size_t at = rand()%(n+1);
+			switch(rand()%3){
+			case 0:	if(at<n) s[at] = pick[rand()%(sizeof(pick)-1)]; break;
+			case 1:	if(n) n = rand()%n; break;					// cut short
+			case 2:	if(n<sizeof(s)-1){ memmove(s+at+1, s+at, n-at);
+						s[at] = pick[rand()%(sizeof(pick)-1)]; ++n; } break;
+			}
+		}
+		LLVMFuzzerTestOneInput((const uint8_t*)s, n);
+	}
+	printf("rfc3339: 5000000 fuzzed, no problems\n");
+	return 0;
+}
+#endif
@@ -0,0 +1,325 @@
+//==============================================================================
+// gcal.h		Read the Google calendar ourselves, no python
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// This does what clock.py does but from inside the clock on the main loop:
+//	1)	use the refresh token in token.json (the one clock.py made) to get an
+//		access token from Google's OAuth server when we haven't got a live one
+//	2)	ask each calendar in calendars.txt (just 'primary' without one) for
+//		its next events with fields= so Google only sends the start and
+//		summary of each, gzip'ed over a kept-alive connection per calendar so
+//		they all go at once and it takes as long as the slowest
+//	3)	merge them (see merge.h) and write them to events.bin (see
+//		snapshot.h) just as clock.py does or if it all went wrong say why
+//		with lines like
+//		* something bad happened
+//
+// token.json still has to be made by running 'python clock.py' once as that
+// needs a browser. If Google says the refresh token is no good (invalid_grant)
+// we say so (CALENDAR::AUTH) so CLOCK can put up the instructions. Other
+// failures say whether they are worth another go, see fetchstate.h.
+//
+// The base URL can be changed (-u) to talk to a test server like mockcal.py
+// in which case the token goes to base/token as well. GCAL is one of the
+// EVENTSOURCEs, see eventsource.h.
+//
+//==============================================================================
+
+#pragma once
+
+#include <glibmm/main.h>
+#include "http.h"
+#include "json.h"
+#include "zone.h"
+#include "eventsource.h"
+#include "snapshot.h"
+#include "rfc3339.h"
+#include "nextn.h"
+#include "merge.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <ctype.h>
+#include <functional>
+#include <time.h>
+#include <errno.h>
+
+class GCAL : public EVENTSOURCE {
+protected:
+	struct SOURCE {							// one calendar
+		std::string id;						// 'primary' or an address
+		HTTP	api;						// a connection each
+		RESPONSE answer;					// kept until they are all back
+	};
+	HTTP	auth;							// the token server
+	std::vector<std::unique_ptr<SOURCE>> sources;	// see calendars()
+	int		pending{0};						// lists still to come back
+	std::string base;						// empty for the real Google
+	ZONE*	zone{nullptr};					// for all day events
+	std::string access;						// the access token
+	time_t	expires{0};						// and when it runs out
+	bool	bRefreshed{false};				// asked for a new one this fetch
+	double	started{0};
+	sigc::connection timer;
+	std::function<void(const CALENDAR&)> onDone;
+
+public:
+	GCAL() = default;
+	GCAL(const GCAL&) = delete;
+	virtual ~GCAL(){ timer.disconnect(); }
+
+	void setZone(ZONE* z)		{ zone = z; }
+	void setBase(const char* b)	{ base = b; while(!base.empty() && base.back()=='/') base.pop_back(); }
+	bool busy() const override	{ return timer.connected(); }
+
+	// Get the next 25 events, done() is always called once
+	void fetch(int timeout, std::function<void(const CALENDAR&)> done) override
+	{
+		if(busy()) return;
+		onDone = done;
+		bRefreshed = false;
+		started = now();
+		calendars();
+		timer = Glib::signal_timeout().connect_seconds([this]{
+					auth.abort();
+					for(auto& s : sources)
+						s->api.abort();
+					return false; }, timeout);
+		if(access.empty() || ::time(nullptr) > expires-60)
+			refresh();
+		else
+			list();
+	}
+
+protected:
+	static double now()
+	{
+		timespec t;
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		return t.tv_sec + t.tv_nsec/1e9;
+	}
+
+	void reply(CALENDAR& c, const char* what)
+	{
+		timer.disconnect();
+		int connects = auth.connects, requests = auth.requests;
+		for(auto& s : sources){
+			connects += s->api.connects;
+			requests += s->api.requests;
+		}
+		snprintf(c.text, sizeof(c.text), "native %s %.2fS %d calendars (%d"
+					" connects %d requests)", what, now()-started,
+					int(sources.size()), connects, requests);
+		onDone(c);
+	}
+
+	void failed(const char* first, const std::string& second,
+											CALENDAR::ERROR error)
+	{
+		CALENDAR c;
+		c.error = error;
+		c.lines.push_back(first);
+		if(!second.empty())
+			c.lines.push_back("* " + second.substr(0, 60));
+		reply(c, "error");
+	}
+
+	// Statuses that mean try again later, 403 is Google's rate limit
+	static bool transient(int status)
+	{
+		return status>=500 || status==429 || status==403;
+	}
+
+	// A time stamp into UTC seconds, all day events start at our midnight
+	int64_t utc(const char* s)
+	{
+		RFC3339 t;
+		return t.parse(s) ? t.local(*zone) : 0;
+	}
+
+	// Swap the refresh token in token.json for an access token
+	void refresh()
+	{
+		std::string text;
+		FILE* f = fopen((dir + "/token.json").c_str(), "r");
+		if(f){
+			char buffer[4096];
+			size_t n;
+			while((n = fread(buffer, 1, sizeof(buffer), f))>0)
+				text.append(buffer, n);
+			fclose(f);
+		}
+		JSON token;
+		if(!token.parse(text) || !*token["refresh_token"].str()){
+			failed("* No token.json *", "", CALENDAR::AUTH);
+			return;
+		}
+		// python may have a good one we can use straight away
+		if(!bRefreshed && *token["token"].str()
+					&& utc(token["expiry"].str()) > ::time(nullptr)+60){
+			access = token["token"].str();
+			expires = utc(token["expiry"].str());
+			list();
+			return;
+		}
+		std::string uri = base.empty()
+					? token["token_uri"].str("https://oauth2.googleapis.com/token")
+					: base + "/token";
+		auth.server(uri);
+		size_t slash = uri.find('/', uri.find("://")+3);
+		std::string form = "grant_type=refresh_token"
+				"&refresh_token=" + HTTP::escape(token["refresh_token"].str()) +
+				"&client_id="     + HTTP::escape(token["client_id"].str()) +
+				"&client_secret=" + HTTP::escape(token["client_secret"].str());
+		auth.request("POST", slash==std::string::npos ? "/" : uri.substr(slash),
+				"Content-Type: application/x-www-form-urlencoded\r\n", form,
+				[this](const RESPONSE& r){ refreshed(r); });
+	}
+
+	void refreshed(const RESPONSE& r)
+	{
+		bRefreshed = true;
+		if(r.status==0){
+			failed("* Token server failed *", r.error, CALENDAR::NETWORK);
+			return;
+		}
+		JSON answer;
+		answer.parse(r.body);
+		if(r.status!=200 || !*answer["access_token"].str()){
+			// invalid_grant is Google's way of saying do it in the browser,
+			// a busy server is worth another go and anything else about our
+			// token.json (a bad client id say) needs a person too
+			bool bDead = strcmp(answer["error"].str(), "invalid_grant")==0;
+			failed(bDead ? "* Token has been expired or revoked *"
+						 : "* Token refresh failed *",
+				   answer["error_description"].str(answer["error"].str()),
+				   transient(r.status) ? CALENDAR::NETWORK : CALENDAR::AUTH);
+			return;
+		}
+		access = answer["access_token"].str();
+		expires = ::time(nullptr) + (answer["expires_in"].n>0
+										? (time_t)answer["expires_in"].n : 3600);
+		list();
+	}
+
+	// Which calendars, from calendars.txt as clock.py does. The HTTP
+	// connections are kept unless the list changes.
+	void calendars()
+	{
+		std::vector<std::string> ids;
+		FILE* f = fopen((dir + "/calendars.txt").c_str(), "r");
+		if(f){
+			char line[256];
+			while(fgets(line, sizeof(line), f)){
+				std::string id = line;
+				while(!id.empty() && isspace((unsigned char)id.back())) id.pop_back();
+				size_t first = id.find_first_not_of(" \t");
+				if(first!=std::string::npos && id[first]!='#')
+					ids.push_back(id.substr(first));
+			}
+			fclose(f);
+		}
+		if(ids.empty())
+			ids.push_back("primary");
+		bool bSame = ids.size()==sources.size();
+		for(size_t i=0; bSame && i<ids.size(); ++i)
+			bSame = ids[i]==sources[i]->id;
+		if(bSame) return;
+		sources.clear();
+		for(auto& id : ids){
+			sources.emplace_back(new SOURCE);
+			sources.back()->id = id;
+		}
+	}
+
+	// The events lists, all at once and only asking for the bits we show
+	void list()
+	{
+		char timeMin[32];
+		time_t t = ::time(nullptr);
+		tm u;
+		gmtime_r(&t, &u);
+		strftime(timeMin, sizeof(timeMin), "%Y-%m-%dT%H:%M:%SZ", &u);
+		pending = int(sources.size());
+		for(size_t k=0; k<sources.size(); ++k){
+			SOURCE& s = *sources[k];
+			s.answer = RESPONSE();
+			s.api.server(base.empty() ? "https://www.googleapis.com" : base);
+			std::string path = "/calendar/v3/calendars/" + HTTP::escape(s.id) +
+					"/events?timeMin=" + HTTP::escape(timeMin) +
+					"&maxResults=25&singleEvents=true&orderBy=startTime"
+					"&fields=" + HTTP::escape("items(id,start,end,summary)");
+			s.api.request("GET", path, "Authorization: Bearer " + access + "\r\n",
+					"", [this, k](const RESPONSE& r){ listed(k, r); });
+		}
+	}
+
+	// One has come back, wait for the lot
+	void listed(size_t k, const RESPONSE& r)
+	{
+		sources[k]->answer = r;
+		if(--pending>0) return;
+
+		for(auto& s : sources)
+			if(s->answer.status==401 && !bRefreshed){	// revoked early
+				bRefreshed = true;				// get another, only once
+				access.clear();
+				refresh();
+				return;
+			}
+		// any calendar failing fails the lot so we keep the last good events
+		// rather than show them with one calendar missing
+		std::vector<std::vector<NEXTN::ITEM>> lists(sources.size());
+		for(size_t k=0; k<sources.size(); ++k){
+			const RESPONSE& a = sources[k]->answer;
+			if(a.status==0){
+				failed("* Calendar server failed *", a.error, CALENDAR::NETWORK);
+				return;
+			}
+			JSON answer;
+			if(a.status!=200 || !answer.parse(a.body)){
+				char temp[40];
+				snprintf(temp, sizeof(temp), "HTTP status %d for ", a.status);
+				failed("* An HTTP error occurred *", temp + sources[k]->id,
+						transient(a.status) ? CALENDAR::NETWORK
+					  : a.status==401  ? CALENDAR::AUTH : CALENDAR::DATA);
+				return;
+			}
+			const JSON& items = answer["items"];
+			for(size_t i=0; i<items.size(); ++i){
+				const JSON& start = items[i]["start"];
+				const JSON& end   = items[i]["end"];
+				NEXTN::ITEM e;
+				e.when = start["dateTime"].str(start["date"].str());
+				if(e.when.size()<10) continue;	// CLOCK wants at least a date
+				e.start    = utc(e.when.c_str());
+				e.end      = utc(end["dateTime"].str(end["date"].str()));
+				e.bAllDay  = start["dateTime"].isNull();
+				e.calendar = int(k);
+				e.summary  = items[i]["summary"].str();
+				e.id       = items[i]["id"].str();
+				lists[k].push_back(std::move(e));
+			}
+			// Google sorts by its idea of the start, make sure it is ours
+			std::stable_sort(lists[k].begin(), lists[k].end(), earlier);
+		}
+		SNAPWRITER w;
+		kmerge(lists, earlier, 25, [&w](const NEXTN::ITEM& e){
+				w.add(e.start, e.end, e.bAllDay, e.when, e.summary, e.id, e.calendar); });
+		if(!w.save((dir + "/events.bin").c_str())){
+			failed("* Can't write events.bin *", strerror(errno), CALENDAR::DATA);
+			return;
+		}
+		CALENDAR c;
+		c.ok = true;
+		reply(c, "ok");
+	}
+
+	static bool earlier(const NEXTN::ITEM& a, const NEXTN::ITEM& b)
+	{
+		return a.start<b.start;
+	}
+};
@@ -0,0 +1,178 @@
+//==============================================================================
+// glyphs.h		Draw text from a cache of pre-rendered characters
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// A Gtk::Label re-shapes and lays out its whole text with Pango every time
+// set_text() is called and at 250px that is the biggest job the Pi does every
+// second. This widget takes a small alphabet (for the clock "0123456789:"),
+// renders each character once into its own Cairo image surface and then just
+// copies those surfaces to the screen. The cache is rebuilt if the CSS
+// changes the font or the colour.
+//
+// Digits all get the same width cell (the widest digit) so nothing moves as
+// the time changes and set_text() only asks GTK to repaint the cells whose
+// character actually changed.
+//
+// It is a Gtk::DrawingArea so the CSS selector is "#name" not "label#name".
+//
+//==============================================================================
+
+#pragma once
+
+#include <gtkmm/drawingarea.h>
+#include <gtkmm/stylecontext.h>
+#include <cairomm/context.h>
+#include <pangomm/layout.h>
+#include <cstring>
+#include "label.h"
+
+class GLYPHS : public Gtk::DrawingArea {
+protected:
+	static const int MAXTEXT = 16;			// longest text we can show
+
+	const char* alphabet;					// the characters we can draw
+	const char* pattern;					// the longest text we expect
+	Cairo::RefPtr<Cairo::ImageSurface> glyph[MAXTEXT];	// one per alphabet
+	int		width[MAXTEXT]{};				// cell width for each of them
+	int		height{0};						// the same for all of them
+	bool	bValid{false};					// the cache is good
+
+	char	text[MAXTEXT+1]{};				// what is on the screen now
+	int		xpos[MAXTEXT+1]{};				// where each character starts
+
+public:
+	GLYPHS(const char* alphabet, const char* pattern)
+		: alphabet(alphabet), pattern(pattern) {}
+	virtual ~GLYPHS(){}
+
+	// Change the longest text we expect, and so our size
+	void set_pattern(const char* p)
+	{
+		pattern = p;
+		queue_resize();
+	}
+
+	// Change the text and ask for the changed cells to be repainted
+	void set_text(const char* s)
+	{
+		if(!bValid) build();
+		int n = strlen(s);
+		if(n>MAXTEXT) n = MAXTEXT;
+		int x = 0;
+		for(int i=0; i<=n || text[i]; ++i){
+			char c = i<n ? s[i] : 0;
+			int w = cell(c!=0 ? c : text[i]);
+			if(c!=text[i] || x!=xpos[i]){
+				queue_draw_area(x, 0, w, height);
+				DAMAGE::add(w, height);
+				if(xpos[i]!=x){					// the old cell is elsewhere
+					queue_draw_area(xpos[i], 0, cell(text[i]), height);
+					DAMAGE::add(cell(text[i]), height);
+				}
+			}
+			text[i] = c;
+			xpos[i] = x;
+			x += w;
+			if(i>=MAXTEXT) break;
+		}
+	}
+
+protected:
+	// Which entry of the alphabet is this character (-1 if it isn't)
+	int index(char c) const
+	{
+		const char* p = c ? strchr(alphabet, c) : nullptr;
+		return p ? int(p-alphabet) : -1;
+	}
+	int cell(char c) const
+	{
+		int i = index(c);
+		return i<0 ? 0 : width[i];
+	}
+
+	// Render every character of the alphabet with the CSS font and colour
+	void build()
+	{
+		auto context = get_style_context();
+		Gdk::RGBA fg = context->get_color(get_state_flags());
+
+		int n = strlen(alphabet), digit = 0;
+		for(int i=0; i<n && i<MAXTEXT; ++i){
+			auto layout = create_pango_layout(Glib::ustring(1, alphabet[i]));
+			int w, h;
+			layout->get_pixel_size(w, h);
+			width[i] = w;
+			height = h;
+			if(alphabet[i]>='0' && alphabet[i]<='9' && w>digit)
+				digit = w;
+		}
+		// now we know the widest digit we can draw them all in a cell that
+		// size, centred so the narrow '1' doesn't look odd
+		for(int i=0; i<n && i<MAXTEXT; ++i){
+			auto layout = create_pango_layout(Glib::ustring(1, alphabet[i]));
+			int w = width[i];
+			if(alphabet[i]>='0' && alphabet[i]<='9')
+				width[i] = digit;
+			glyph[i] = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32,
+															width[i], height);
+			auto cr = Cairo::Context::create(glyph[i]);
+			cr->set_source_rgba(fg.get_red(), fg.get_green(), fg.get_blue(),
+															fg.get_alpha());
+			cr->move_to((width[i]-w)/2, 0);
+			layout->show_in_cairo_context(cr);
+			glyph[i]->flush();
+		}
+		bValid = true;
+	}
+
+	// Our size is fixed by the pattern so changing the text never resizes us
+	void get_preferred_width_vfunc(int& minimum, int& natural) const override
+	{
+		if(!bValid) const_cast<GLYPHS*>(this)->build();
+		minimum = 0;
+		for(const char* p=pattern; *p; ++p)
+			minimum += cell(*p);
+		natural = minimum;
+	}
+	void get_preferred_height_vfunc(int& minimum, int& natural) const override
+	{
+		if(!bValid) const_cast<GLYPHS*>(this)->build();
+		minimum = natural = height;
+	}
+
+	// New CSS so throw away the cache and maybe change size
+	void on_style_updated() override
+	{
+		Gtk::DrawingArea::on_style_updated();
+		bValid = false;
+		build();
+		char old[MAXTEXT+1];
+		strcpy(old, text);
+		text[0] = 0;
+		set_text(old);						// recalculate the positions
+		queue_resize();
+		queue_draw();
+		DAMAGE::add(get_allocated_width(), get_allocated_height());
+	}
+
+	// Copy in the cells that GTK wants repainting
+	bool on_draw(const Cairo::RefPtr<Cairo::Context>& cr) override
+	{
+		if(!bValid) build();
+		double x1, y1, x2, y2;
+		cr->get_clip_extents(x1, y1, x2, y2);
+		for(int i=0; text[i]; ++i){
+			int g = index(text[i]);
+			if(g<0) continue;
+			if(xpos[i]+width[g]<=x1 || xpos[i]>=x2)
+				continue;						// not in the damaged area
+			cr->set_source(glyph[g], xpos[i], 0);
+			cr->rectangle(xpos[i], 0, width[g], height);
+			cr->fill();
+		}
+		return true;
+	}
+};
@@ -0,0 +1,470 @@
+//==============================================================================
+// http.h		A small HTTP/1.1 client that runs on the Glib main loop
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// HTTP talks to one server (https:// or http:// for testing) with GIO's
+// socket client doing the connecting and TLS. Everything is asynchronous so
+// the clock keeps ticking while we wait. The connection is kept open between
+// requests (keep-alive) and we ask for gzip'ed answers which zlib undoes.
+// Only one request at a time, the callback says when it has finished.
+//
+// HTTPPARSE is the protocol half: it is fed whatever bytes arrive and works
+// out the status, headers and body (Content-Length, chunked or until the
+// server hangs up) so it doesn't need a network to try it out.
+//
+// If the server has quietly dropped a kept-alive connection the first read or
+// write fails so we connect again and resend it once.
+//
+// HTTP uses GIO's C calls (g_socket_client_...) rather than giomm's
+// Gio::SocketClient on purpose. giomm's _finish() calls report every error,
+// including our own cancel from abort(), by throwing a Glib::Error from
+// inside a main loop callback. The C calls hand back a GError we can look at
+// (was it just cancelled?) and nothing else in the clock uses exceptions, so
+// failures stay plain values all the way to CALENDAR.
+//
+// 'clock -b http' feeds HTTPPARSE and JSON canned answers, split every way
+// across reads, and some broken ones.
+//
+//==============================================================================
+
+#pragma once
+
+#include <gio/gio.h>
+#include <zlib.h>
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <strings.h>
+#include <stdlib.h>
+
+struct RESPONSE {
+	int		status{0};						// 0 if we never got one
+	std::string error;						// why not
+	std::vector<std::pair<std::string, std::string>> headers;
+	std::string body;
+
+	const char* header(const char* name) const
+	{
+		for(auto& h : headers)
+			if(strcasecmp(h.first.c_str(), name)==0)
+				return h.second.c_str();
+		return nullptr;
+	}
+};
+
+class HTTPPARSE {
+protected:
+	enum { HEAD, BODY, TOEND, SIZE, CHUNK, CHUNKEND, TRAILER, DONE, FAIL } state{HEAD};
+	std::string line;						// a header or chunk size line
+	size_t	left{0};						// body or chunk bytes to come
+	bool	bGzip{false};
+	size_t	count{0};						// bytes seen
+
+public:
+	RESPONSE r;
+	bool	bClose{false};					// the server will hang up after
+
+	void reset()
+	{
+		*this = HTTPPARSE();
+	}
+	bool done() const	{ return state==DONE; }
+	bool failed() const	{ return state==FAIL; }
+	size_t received() const { return count; }
+
+	// Take some more of the answer, false once it is complete or broken
+	bool feed(const char* p, size_t n)
+	{
+		count += n;
+		const char* e = p + n;
+		while(p<e && state!=DONE && state!=FAIL){
+			switch(state){
+			case HEAD:
+			case SIZE:
+			case CHUNKEND:
+			case TRAILER:
+				{
+					const char* nl = (const char*)memchr(p, '\n', e-p);
+					if(!nl){
+						line.append(p, e-p);
+						p = e;
+						if(line.size()>16384) fail("header too long");
+						break;
+					}
+					line.append(p, nl-p);
+					p = nl+1;
+					if(!line.empty() && line.back()=='\r') line.pop_back();
+					gotLine();
+					line.clear();
+				}
+				break;
+			case BODY:
+			case CHUNK:
+				{
+					size_t take = std::min(left, size_t(e-p));
+					r.body.append(p, take);
+					p += take;
+					left -= take;
+					if(left==0){
+						if(state==BODY) finish();
+						else state = CHUNKEND;
+					}
+				}
+				break;
+			case TOEND:
+				r.body.append(p, e-p);
+				p = e;
+				break;
+			default:
+				break;
+			}
+		}
+		return state!=DONE && state!=FAIL;
+	}
+
+	// The server hung up, which is the end for a TOEND body
+	void eof()
+	{
+		if(state==TOEND)
+			finish();
+		else if(state!=DONE)
+			fail("connection closed early");
+	}
+
+protected:
+	void fail(const char* why)
+	{
+		r.error = why;
+		state = FAIL;
+	}
+
+	void gotLine()
+	{
+		if(state==SIZE){
+			left = strtoul(line.c_str(), nullptr, 16);
+			state = left ? CHUNK : TRAILER;
+			return;
+		}
+		if(state==CHUNKEND){				// the CRLF after a chunk
+			state = SIZE;
+			return;
+		}
+		if(state==TRAILER){
+			if(line.empty()) finish();
+			return;
+		}
+		// HEAD: the status line first and then headers up to a blank line
+		if(r.status==0){
+			int major, minor;
+			if(sscanf(line.c_str(), "HTTP/%d.%d %d", &major, &minor, &r.status)!=3
+															|| r.status<100){
+				fail("not HTTP");
+				return;
+			}
+			if(major==1 && minor==0) bClose = true;
+			return;
+		}
+		if(!line.empty()){
+			size_t colon = line.find(':');
+			if(colon==std::string::npos) return;
+			size_t v = line.find_first_not_of(" \t", colon+1);
+			r.headers.emplace_back(line.substr(0, colon),
+							v==std::string::npos ? "" : line.substr(v));
+			return;
+		}
+		// the blank line so now the body
+		const char* te = r.header("Transfer-Encoding");
+		const char* cl = r.header("Content-Length");
+		const char* ce = r.header("Content-Encoding");
+		const char* cn = r.header("Connection");
+		bGzip = ce && strcasecmp(ce, "gzip")==0;
+		if(cn && strcasecmp(cn, "close")==0) bClose = true;
+		if(cn && strcasecmp(cn, "keep-alive")==0) bClose = false;
+		if(r.status==204 || r.status==304 || r.status<200)
+			finish();
+		else if(te && strcasestr(te, "chunked"))
+			state = SIZE;
+		else if(cl){
+			left = strtoul(cl, nullptr, 10);
+			state = BODY;
+			if(left==0) finish();
+		}
+		else{
+			state = TOEND;					// until the server hangs up
+			bClose = true;
+		}
+	}
+
+	void finish()
+	{
+		state = DONE;
+		if(bGzip && !gunzip())
+			fail("bad gzip");
+	}
+
+	bool gunzip()
+	{
+		z_stream z{};
+		if(inflateInit2(&z, 16+MAX_WBITS)!=Z_OK) return false;
+		std::string out;
+		char buffer[16384];
+		z.next_in = (Bytef*)r.body.data();
+		z.avail_in = r.body.size();
+		int result;
+		do{
+			z.next_out = (Bytef*)buffer;
+			z.avail_out = sizeof(buffer);
+			result = inflate(&z, Z_NO_FLUSH);
+			if(result!=Z_OK && result!=Z_STREAM_END){
+				inflateEnd(&z);
+				return false;
+			}
+			out.append(buffer, sizeof(buffer)-z.avail_out);
+		}while(result!=Z_STREAM_END && (z.avail_in>0 || z.avail_out==0));
+		inflateEnd(&z);
+		r.body.swap(out);
+		return result==Z_STREAM_END;
+	}
+};
+
+class HTTP {
+protected:
+	std::string scheme, host;
+	int		port{0};
+	GSocketClient*		client{nullptr};
+	GSocketConnection*	conn{nullptr};
+	GCancellable*		cancel{nullptr};
+
+	std::string out;						// the request being sent
+	char	buffer[16384];
+	HTTPPARSE parser;
+	bool	bBusy{false};
+	bool	bReused{false};					// sent on an old connection
+	std::function<void(const RESPONSE&)> onDone;
+
+public:
+	int		connects{0}, requests{0};		// to show keep-alive works
+
+	HTTP()
+	{
+		client = g_socket_client_new();
+		cancel = g_cancellable_new();
+		g_socket_client_set_timeout(client, 30);
+	}
+	HTTP(const HTTP&) = delete;
+	virtual ~HTTP()
+	{
+		g_cancellable_cancel(cancel);
+		drop();
+		g_object_unref(client);
+		g_object_unref(cancel);
+	}
+
+	bool busy() const { return bBusy; }
+
+	// Give up on the request in flight (callbacks still come but are ignored)
+	void abort()
+	{
+		if(!bBusy) return;
+		g_cancellable_cancel(cancel);
+		g_object_unref(cancel);
+		cancel = g_cancellable_new();
+		fail("timed out");
+	}
+
+	// Split http[s]://host[:port] and use it from now on
+	bool server(const std::string& url)
+	{
+		size_t colon = url.find("://");
+		if(colon==std::string::npos) return false;
+		std::string s = url.substr(0, colon);
+		std::string h = url.substr(colon+3);
+		h = h.substr(0, h.find('/'));
+		int p = s=="https" ? 443 : 80;
+		size_t c = h.rfind(':');
+		if(c!=std::string::npos && h.find(']', c)==std::string::npos){
+			p = atoi(h.c_str()+c+1);
+			h.resize(c);
+		}
+		if(s!=scheme || h!=host || p!=port)
+			drop();
+		scheme = s;
+		host = h;
+		port = p;
+		g_socket_client_set_tls(client, scheme=="https");
+		return true;
+	}
+
+	// Send a request, 'extra' is more header lines each ending \r\n
+	void request(const char* method, const std::string& path,
+				 const std::string& extra, const std::string& body,
+				 std::function<void(const RESPONSE&)> done)
+	{
+		if(bBusy){
+			RESPONSE r;
+			r.error = "busy";
+			done(r);
+			return;
+		}
+		bBusy = true;
+		onDone = done;
+		++requests;
+		out = std::string(method) + " " + path + " HTTP/1.1\r\n"
+			+ "Host: " + host + "\r\n"
+			+ "User-Agent: Pi-Clock\r\n"
+			+ "Accept-Encoding: gzip\r\n"
+			+ "Connection: keep-alive\r\n"
+			+ extra;
+		if(!body.empty() || strcmp(method, "POST")==0)
+			out += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+		out += "\r\n" + body;
+
+		if(conn){
+			bReused = true;
+			send();
+		}
+		else{
+			bReused = false;
+			connect();
+		}
+	}
+
+	// %-encode for a query string or a form
+	static std::string escape(const std::string& s)
+	{
+		static const char hexd[] = "0123456789ABCDEF";
+		std::string r;
+		for(unsigned char c : s){
+			if(isalnum(c) || strchr("-_.~", c))
+				r += c;
+			else{
+				r += '%';
+				r += hexd[c>>4];
+				r += hexd[c&15];
+			}
+		}
+		return r;
+	}
+
+protected:
+	void drop()
+	{
+		if(conn){
+			g_io_stream_close(G_IO_STREAM(conn), nullptr, nullptr);
+			g_object_unref(conn);
+			conn = nullptr;
+		}
+	}
+
+	void connect()
+	{
+		g_socket_client_connect_to_host_async(client, host.c_str(), port,
+										cancel, connected, this);
+	}
+	static void connected(GObject* source, GAsyncResult* result, gpointer data)
+	{
+		GError* error = nullptr;
+		GSocketConnection* c = g_socket_client_connect_to_host_finish(
+								G_SOCKET_CLIENT(source), result, &error);
+		if(!c){
+			bool cancelled = g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+			std::string why = error->message;
+			g_error_free(error);
+			if(!cancelled)
+				((HTTP*)data)->fail(why.c_str());
+			return;
+		}
+		HTTP* self = (HTTP*)data;
+		self->conn = c;
+		++self->connects;
+		self->send();
+	}
+
+	void send()
+	{
+		parser.reset();
+		g_output_stream_write_all_async(
+				g_io_stream_get_output_stream(G_IO_STREAM(conn)),
+				out.data(), out.size(), G_PRIORITY_DEFAULT, cancel, sent, this);
+	}
+	static void sent(GObject* source, GAsyncResult* result, gpointer data)
+	{
+		GError* error = nullptr;
+		gsize n;
+		if(!g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), result,
+															&n, &error)){
+			if(!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+				((HTTP*)data)->retry(error->message);
+			g_error_free(error);
+			return;
+		}
+		((HTTP*)data)->receive();
+	}
+
+	void receive()
+	{
+		g_input_stream_read_async(g_io_stream_get_input_stream(G_IO_STREAM(conn)),
+				buffer, sizeof(buffer), G_PRIORITY_DEFAULT, cancel, received, this);
+	}
+	static void received(GObject* source, GAsyncResult* result, gpointer data)
+	{
+		GError* error = nullptr;
+		gssize n = g_input_stream_read_finish(G_INPUT_STREAM(source), result, &error);
+		if(n<0){
+			if(!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+				((HTTP*)data)->retry(error->message);
+			g_error_free(error);
+			return;
+		}
+		HTTP* self = (HTTP*)data;
+		if(n==0){
+			if(self->parser.received()==0){
+				self->retry("connection closed");
+				return;
+			}
+			self->parser.eof();
+		}
+		else
+			self->parser.feed(self->buffer, n);
+
+		if(self->parser.failed())
+			self->fail(self->parser.r.error.c_str());
+		else if(self->parser.done())
+			self->finish();
+		else
+			self->receive();
+	}
+
+	// An old kept-alive connection may have gone stale so have one more go
+	void retry(const char* why)
+	{
+		drop();
+		if(bReused && parser.received()==0){
+			bReused = false;
+			connect();
+			return;
+		}
+		fail(why);
+	}
+
+	void fail(const char* why)
+	{
+		drop();
+		RESPONSE r;
+		r.error = why;
+		bBusy = false;
+		onDone(r);
+	}
+
+	void finish()
+	{
+		if(parser.bClose)
+			drop();
+		bBusy = false;
+		onDone(parser.r);
+	}
+};
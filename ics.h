@@ -0,0 +1,435 @@
+//==============================================================================
+// ics.h		Read an iCalendar (.ics) file as it streams past
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// An .ics file (RFC 5545) is what Google, Outlook, Nextcloud and vdirsyncer
+// export and sync. It is lines of NAME;PARAM=x:VALUE with long lines folded
+// by starting the next one with a space, and the events are between
+//		BEGIN:VEVENT
+//		DTSTART;TZID=Europe/London:20221013T120000
+//		DTEND;TZID=Europe/London:20221013T130000
+//		SUMMARY:Lunch with Robin
+//		END:VEVENT
+// in any order. feed() takes the bytes in pieces of any size, joins the folded
+// lines and offers each event to a NEXTN (see nextn.h) so a file of any size
+// is read in the memory of the events we keep.
+//
+// Times are UTC (a Z on the end), in a TZID zone which we look up in the
+// system's zone files rather than believing the VTIMEZONE blocks, or
+// 'floating' which means our local time. A date on its own is an all day
+// event from our local midnight.
+//
+// Repeats (RRULE) are done for FREQ=DAILY/WEEKLY/MONTHLY/YEARLY with
+// INTERVAL, COUNT and UNTIL, starting from the DTSTART date. The BYDAY sort of
+// rules, EXDATE and moved single repeats (RECURRENCE-ID) are not, an event
+// like that just repeats on the day of the week (or month) it first did.
+//
+//==============================================================================
+
+#pragma once
+
+#include "zone.h"
+#include "nextn.h"
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <errno.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+class ICS {
+public:
+	long	events{0};						// VEVENTs seen
+	long	bad{0};							// and ones we couldn't use
+
+protected:
+	struct TIME {
+		int		y{0}, m{0}, d{0}, secs{0};
+		bool	bDate{false};				// no time so all day
+		bool	bUTC{false};				// ended with Z
+		ZONE*	zone{nullptr};				// TZID or nullptr for ours
+		bool	bSet{false};
+	};
+	struct EVENT {
+		TIME	start, end;
+		int64_t	duration{-1};				// seconds, -1 for none
+		std::string summary, uid;
+		bool	bCancelled{false};
+		int		freq{0};					// 0 none, 1 day, 2 week, 3 month, 4 year
+		int		interval{1};
+		long	count{0};					// 0 for forever
+		TIME	until;
+	};
+
+	NEXTN&	out;
+	ZONE&	local;
+	std::string line;						// the one we are joining up
+	bool	bEol{false};					// it may go on in the next line
+	bool	bIn{false};						// inside BEGIN:VEVENT
+	int		nested{0};						// VALARMs inside that
+	EVENT	e;
+	std::map<std::string, std::unique_ptr<ZONE>> zones;	// by TZID
+	static const size_t MAXLINE = 1<<16;	// a line longer is cut off
+
+public:
+	ICS(NEXTN& out, ZONE& local) : out(out), local(local) {}
+
+	// The next piece of the file
+	void feed(const char* p, size_t n)
+	{
+		const char* end = p + n;
+		while(p<end){
+			if(bEol){						// a space or tab carries it on
+				if(*p==' ' || *p=='\t'){
+					++p;
+					bEol = false;
+					continue;
+				}
+				property();
+				bEol = false;
+			}
+			const char* eol = (const char*)memchr(p, '\n', end-p);
+			const char* stop = eol ? eol : end;
+			if(line.size()<MAXLINE)
+				line.append(p, std::min(size_t(stop-p), MAXLINE-line.size()));
+			if(!eol) return;
+			if(!line.empty() && line.back()=='\r')
+				line.pop_back();
+			bEol = true;
+			p = eol+1;
+		}
+	}
+
+	// The end of the file
+	void finish()
+	{
+		if(bEol || !line.empty())
+			property();
+		bEol = false;
+	}
+
+	// The lot from a file descriptor, false on a read error or if 'stop'
+	// became true
+	bool read(int fd, const std::atomic<bool>* stop=nullptr)
+	{
+		std::vector<char> buffer(1<<16);
+		ssize_t n;
+		while((n = ::read(fd, buffer.data(), buffer.size()))!=0){
+			if(n<0 && errno==EINTR) continue;
+			if(n<0 || (stop && *stop)) return false;
+			feed(buffer.data(), n);
+		}
+		finish();
+		return true;
+	}
+
+protected:
+	// One whole line, NAME;PARAM=VALUE;PARAM="A:B":VALUE
+	void property()
+	{
+		const char* p = line.c_str();
+		size_t n = line.size();
+		size_t nameEnd = strcspn(p, ";:");
+		char name[16];
+		if(nameEnd>=sizeof(name) || nameEnd==n){
+			line.clear();
+			return;							// nothing we want
+		}
+		for(size_t i=0; i<nameEnd; ++i)
+			name[i] = (p[i]>='a' && p[i]<='z') ? p[i]-32 : p[i];
+		name[nameEnd] = 0;
+
+		// the parameters, a ':' in quotes doesn't count
+		std::string tzid;
+		size_t i = nameEnd;
+		bool bQuote = false;
+		for( ; i<n && (bQuote || p[i]!=':'); ++i){
+			if(p[i]=='"') bQuote = !bQuote;
+			else if(!bQuote && p[i]==';' && strncasecmp(p+i+1, "TZID=", 5)==0){
+				size_t from = i+6, to = from;
+				if(p[from]=='"')
+					to = line.find('"', ++from);
+				else
+					to = strcspn(p+from, ";:") + from;
+				if(to==std::string::npos) to = n;
+				tzid.assign(p+from, to-from);
+			}
+		}
+		const char* value = i<n ? p+i+1 : p+n;
+		size_t len = p+n-value;
+
+		if(strcmp(name, "BEGIN")==0){
+			if(bIn)
+				++nested;
+			else if(upper(value, len, "VEVENT")){
+				bIn = true;
+				e = EVENT();
+			}
+		}
+		else if(strcmp(name, "END")==0){
+			if(nested)
+				--nested;
+			else if(bIn && upper(value, len, "VEVENT")){
+				bIn = false;
+				++events;
+				emit();
+			}
+		}
+		else if(bIn && !nested){
+			if(strcmp(name, "DTSTART")==0)
+				stamp(value, len, tzid, e.start);
+			else if(strcmp(name, "DTEND")==0)
+				stamp(value, len, tzid, e.end);
+			else if(strcmp(name, "DURATION")==0)
+				e.duration = duration(value, len);
+			else if(strcmp(name, "SUMMARY")==0)
+				text(value, len, e.summary);
+			else if(strcmp(name, "UID")==0)
+				e.uid.assign(value, len);
+			else if(strcmp(name, "STATUS")==0)
+				e.bCancelled = upper(value, len, "CANCELLED");
+			else if(strcmp(name, "RRULE")==0)
+				rule(value, len);
+		}
+		line.clear();
+	}
+
+	static bool upper(const char* v, size_t n, const char* want)
+	{
+		return n==strlen(want) && strncasecmp(v, want, n)==0;
+	}
+
+	// 20221013 or 20221013T120000 or 20221013T120000Z
+	bool stamp(const char* v, size_t n, const std::string& tzid, TIME& t)
+	{
+		t = TIME();
+		if(n!=8 && n!=15 && n!=16) return false;
+		for(size_t i=0; i<n; ++i)
+			if(i!=8 && !(i==15 && (v[i]|0x20)=='z') && unsigned(v[i]-'0')>9)
+				return false;
+		auto num = [v](int at, int len){
+			int x = 0;
+			for(int i=0; i<len; ++i) x = x*10 + v[at+i]-'0';
+			return x;
+		};
+		t.y = num(0, 4);
+		t.m = num(4, 2);
+		t.d = num(6, 2);
+		if(t.m<1 || t.m>12 || t.d<1 || t.d>31) return false;
+		t.bDate = n==8;
+		if(!t.bDate){
+			if((v[8]|0x20)!='t') return false;
+			int hh = num(9, 2), mm = num(11, 2), ss = num(13, 2);
+			if(hh>23 || mm>59 || ss>60) return false;
+			t.secs = hh*3600 + mm*60 + ss;
+			t.bUTC = n==16;
+		}
+		if(!t.bUTC && !tzid.empty())
+			t.zone = zone(tzid);
+		return t.bSet = true;
+	}
+
+	// A TZID's zone, the first time from the zone files, nullptr if we
+	// don't know it (a Windows name say) so it is taken as our time
+	ZONE* zone(const std::string& tzid)
+	{
+		auto it = zones.find(tzid);
+		if(it==zones.end()){
+			std::unique_ptr<ZONE> z(new ZONE);
+			if(tzid.find("..")!=std::string::npos || !z->load(tzid.c_str()))
+				z.reset();
+			it = zones.emplace(tzid, std::move(z)).first;
+		}
+		return it->second.get();
+	}
+
+	// A wall clock time in zone z (or ours) to UTC seconds
+	int64_t utc(int y, int m, int d, int secs, bool bUTC, ZONE* z)
+	{
+		int64_t wall = ZONE::days(y, m, d)*86400 + secs;
+		if(bUTC) return wall;
+		ZONE& zz = z ? *z : local;
+		tm t;
+		zz.local(wall, &t);					// the offset about then
+		zz.local(wall - t.tm_gmtoff, &t);	// and again in case that crossed
+		return wall - t.tm_gmtoff;			// a change
+	}
+	int64_t utc(const TIME& t)
+	{
+		return utc(t.y, t.m, t.d, t.secs, t.bUTC, t.bDate ? nullptr : t.zone);
+	}
+
+	// P1W, P2DT3H, -PT15M... in seconds
+	static int64_t duration(const char* v, size_t n)
+	{
+		int64_t total = 0, x = 0;
+		bool bNeg = n && v[0]=='-';
+		for(size_t i=0; i<n; ++i){
+			char c = v[i] & ~0x20;			// upper case
+			if(unsigned(v[i]-'0')<=9)
+				x = std::min<int64_t>(x*10 + v[i]-'0', 1000000000);
+			else{
+				total += x * (c=='W' ? 7*86400 : c=='D' ? 86400 : c=='H' ? 3600
+							: c=='M' ? 60 : c=='S' ? 1 : 0);
+				x = 0;
+			}
+		}
+		return bNeg ? -total : total;
+	}
+
+	// Undo the \, \; \n and \\ escapes
+	static void text(const char* v, size_t n, std::string& out)
+	{
+		out.clear();
+		for(size_t i=0; i<n; ++i){
+			if(v[i]=='\\' && i+1<n){
+				char c = v[++i];
+				out += (c=='n' || c=='N') ? ' ' : c;
+			}
+			else
+				out += v[i];
+		}
+	}
+
+	// FREQ=WEEKLY;INTERVAL=2;COUNT=10 or UNTIL=20221231T000000Z
+	void rule(const char* v, size_t n)
+	{
+		std::string r(v, n);
+		size_t at = 0;
+		while(at<r.size()){
+			size_t semi = r.find(';', at);
+			if(semi==std::string::npos) semi = r.size();
+			std::string part = r.substr(at, semi-at);
+			at = semi+1;
+			size_t eq = part.find('=');
+			if(eq==std::string::npos) continue;
+			std::string key = part.substr(0, eq), val = part.substr(eq+1);
+			for(auto& c : key) c = toupper((unsigned char)c);
+			for(auto& c : val) c = toupper((unsigned char)c);
+			if(key=="FREQ")
+				e.freq = val=="DAILY" ? 1 : val=="WEEKLY" ? 2 : val=="MONTHLY" ? 3
+					   : val=="YEARLY" ? 4 : 0;
+			else if(key=="INTERVAL")
+				e.interval = std::max(1, std::min(atoi(val.c_str()), 1000));
+			else if(key=="COUNT")
+				e.count = std::max(1, atoi(val.c_str()));
+			else if(key=="UNTIL")
+				stamp(val.c_str(), val.size(), std::string(), e.until);
+		}
+	}
+
+	// END:VEVENT, work out the times and offer it (and its repeats)
+	void emit()
+	{
+		if(!e.start.bSet){
+			++bad;
+			return;
+		}
+		if(e.bCancelled) return;
+		int64_t start = utc(e.start);
+		int64_t length;						// seconds or days if all day
+		if(e.start.bDate)
+			length = e.end.bSet ? ZONE::days(e.end.y, e.end.m, e.end.d)
+									- ZONE::days(e.start.y, e.start.m, e.start.d)
+				   : e.duration>=0 ? e.duration/86400 : 1;
+		else
+			length = e.end.bSet ? utc(e.end) - start
+				   : e.duration>=0 ? e.duration : 0;
+		length = std::max<int64_t>(length, 0);
+		if(!e.freq){
+			offer(start, e.start, length);
+			return;
+		}
+
+		// Repeats: skip to just before 'after' and then take them until
+		// they can't make it into NEXTN
+		int64_t until = !e.until.bSet ? INT64_MAX
+					  : e.until.bDate ? utc(e.until.y, e.until.m, e.until.d,
+											86399, false, nullptr)
+					  : utc(e.until);
+		int64_t k = 0;
+		long done = 0;						// real dates so far, for COUNT
+		if(out.after>INT64_MIN/2){
+			int64_t day = out.after/86400 - (e.start.bDate ? length : length/86400+1);
+			if(e.freq<=2){
+				int64_t step = e.interval * (e.freq==2 ? 7 : 1);
+				k = (day - ZONE::days(e.start.y, e.start.m, e.start.d))/step - 1;
+			}
+			else{
+				int y, m, d;
+				ZONE::civil(day, y, m, d);
+				int64_t months = (y*12+m) - (e.start.y*12+e.start.m);
+				k = months/(e.interval * (e.freq==4 ? 12 : 1)) - 1;
+			}
+			k = std::max<int64_t>(k, 0);
+			if(e.freq<=2)					// every step is a date
+				done = k;
+			else if(e.count){				// count those we skipped over
+				TIME t;
+				for(int64_t j=0; j<k && done<e.count; ++j)
+					done += repeat(j, t);
+			}
+		}
+		for(int64_t stop=k+1000; k<stop && (!e.count || done<e.count); ++k){
+			TIME t;
+			if(!repeat(k, t))
+				continue;					// no 31st this month, doesn't count
+			++done;
+			int64_t s = utc(t);
+			if(s>until || s>out.last()) break;
+			offer(s, t, length);
+		}
+	}
+
+	// The k'th repeat of e in t, false if that isn't a date (the 31st of a
+	// short month or the 29th of February) which RFC 5545 says to leave out
+	// and not count
+	bool repeat(int64_t k, TIME& t)
+	{
+		t = e.start;
+		if(e.freq<=2){
+			int64_t step = e.interval * (e.freq==2 ? 7 : 1);
+			ZONE::civil(ZONE::days(e.start.y, e.start.m, e.start.d) + k*step,
+															t.y, t.m, t.d);
+			return true;
+		}
+		int64_t months = (e.start.y*12 + e.start.m-1)
+						+ k*e.interval*(e.freq==4 ? 12 : 1);
+		t.y = int(months/12);
+		t.m = int(months%12) + 1;
+		int y, m, d;
+		ZONE::civil(ZONE::days(t.y, t.m, t.d), y, m, d);
+		return m==t.m;
+	}
+
+	void offer(int64_t start, const TIME& t, int64_t length)
+	{
+		int64_t end = start + length;
+		if(t.bDate){						// local midnight to midnight
+			int y, m, d;
+			ZONE::civil(ZONE::days(t.y, t.m, t.d) + length, y, m, d);
+			end = utc(y, m, d, 0, false, nullptr);
+		}
+		char when[64];						// room for any int, not just 4 digits
+		if(t.bDate)
+			snprintf(when, sizeof(when), "%04d-%02d-%02d", t.y, t.m, t.d);
+		else{
+			int y, m, d;
+			int64_t day = start>=0 ? start/86400 : (start-86399)/86400;
+			int secs = int(start - day*86400);
+			ZONE::civil(day, y, m, d);
+			snprintf(when, sizeof(when), "%04d-%02d-%02dT%02d:%02d:%02dZ", y, m, d,
+						secs/3600, secs/60%60, secs%60);
+		}
+		out.offer(start, std::max(end, start+1), t.bDate, when, e.summary, e.uid);
+	}
+};
@@ -0,0 +1,147 @@
+//==============================================================================
+// icssource.h	The calendar from an .ics file, no network needed
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// With 'clock -i file.ics' the events come from a file on the disk that
+// something else keeps up to date (vdirsyncer, a Nextcloud client, a cron job
+// with curl or just an export copied over) so the clock works with no Google
+// account and no network at all.
+//
+// A big calendar can take a while to go through on a Pi so the reading is
+// done on a thread of its own with its own ZONE, reading the file through
+// ICS (see ics.h) into a NEXTN of 25 and writing those to events.bin like the
+// other sources. When it is done it pokes a Glib::Dispatcher which gets us
+// back on the main loop to join the thread and call done(). If it takes too
+// long the timeout sets bStop and the thread gives up at the next buffer.
+//
+//==============================================================================
+
+#pragma once
+
+#include <glibmm/main.h>
+#include <glibmm/dispatcher.h>
+#include "eventsource.h"
+#include "snapshot.h"
+#include "nextn.h"
+#include "ics.h"
+#include "zone.h"
+#include <string>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+class ICSSOURCE : public EVENTSOURCE {
+protected:
+	std::string file;						// the .ics
+	std::thread thread;						// reading it
+	std::atomic<bool> bStop{false};			// give up
+	bool	bBusy{false};
+	Glib::Dispatcher finished;				// the thread is done
+	sigc::connection timer;
+	CALENDAR answer;						// only touched by the thread
+	double	started{0};
+	long	events{0}, bad{0};				// what the thread found
+	std::function<void(const CALENDAR&)> onDone;
+
+public:
+	ICSSOURCE()
+	{
+		finished.connect([this]{
+			thread.join();
+			timer.disconnect();
+			bBusy = false;
+			char text[60];
+			snprintf(text, sizeof(text), " %.2fS %ld events", now()-started, events);
+			size_t used = strlen(answer.text);
+			snprintf(answer.text+used, sizeof(answer.text)-used, "%s", text);
+			onDone(answer);
+		});
+	}
+	ICSSOURCE(const ICSSOURCE&) = delete;
+	virtual ~ICSSOURCE()
+	{
+		timer.disconnect();
+		bStop = true;
+		if(thread.joinable())
+			thread.join();
+	}
+
+	void setFile(const char* f)		{ file = f; }
+	bool busy() const override		{ return bBusy; }
+
+	// Read the file on a thread, done() is called once from the main loop
+	void fetch(int timeout, std::function<void(const CALENDAR&)> done) override
+	{
+		if(bBusy) return;
+		onDone = done;
+		bBusy = true;
+		bStop = false;
+		started = now();
+		answer = CALENDAR();
+		timer = Glib::signal_timeout().connect_seconds(
+					[this]{ bStop = true; return false; }, timeout);
+		thread = std::thread([this]{ work(); finished.emit(); });
+	}
+
+protected:
+	static double now()
+	{
+		timespec t;
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		return t.tv_sec + t.tv_nsec/1e9;
+	}
+
+	// On the thread, nothing here may touch GTK or CLOCK
+	void work()
+	{
+		ZONE zone;							// ours, CLOCK's isn't shared
+		NEXTN next(25, ::time(nullptr));	// those not finished yet
+		ICS ics(next, zone);
+		int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd<0){
+			fail("* Can't read ", file, strerror(errno));
+			return;
+		}
+		bool ok = ics.read(fd, &bStop);
+		int e = errno;
+		::close(fd);
+		events = ics.events;
+		bad    = ics.bad;
+		if(!ok){
+			fail(bStop ? "* Took too long reading " : "* Can't read ", file,
+											bStop ? "" : strerror(e));
+			return;
+		}
+		if(events==0 && bad==0){
+			fail("* No events in ", file, "");
+			return;
+		}
+		SNAPWRITER w;
+		for(auto& i : next.sorted())
+			w.add(i.start, i.end, i.bAllDay, i.when, i.summary, i.id, i.calendar);
+		if(!w.save((dir + "/events.bin").c_str())){
+			fail("* Can't write events.bin", std::string(), strerror(errno));
+			return;
+		}
+		answer.ok = true;
+		snprintf(answer.text, sizeof(answer.text), "ics ok");
+	}
+
+	void fail(const char* first, const std::string& name, const char* second)
+	{
+		answer.ok = false;
+		answer.error = CALENDAR::DATA;
+		answer.lines.push_back(first + name + " *");
+		if(*second)
+			answer.lines.push_back(std::string("* ") + second);
+		snprintf(answer.text, sizeof(answer.text), "ics failed");
+	}
+};
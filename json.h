@@ -0,0 +1,217 @@
+//==============================================================================
+// json.h		Just enough JSON to read Google's answers
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// A small recursive parser into a tree of JSON values. Asking for a field or
+// an item that isn't there gives back a null value rather than failing so
+//		json["start"]["dateTime"].str()
+// is safe on any answer.
+//
+//==============================================================================
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdlib.h>
+#include <string.h>
+
+class JSON {
+public:
+	enum TYPE { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+	TYPE	type{NUL};
+	bool	b{false};
+	double	n{0};
+	std::string s;
+	std::vector<JSON> items;								// ARRAY
+	std::vector<std::pair<std::string, JSON>> fields;		// OBJECT
+
+	// Look things up, missing ones are null
+	const JSON& operator[](const char* key) const
+	{
+		for(auto& f : fields)
+			if(f.first==key)
+				return f.second;
+		return null();
+	}
+	const JSON& operator[](size_t i) const
+	{
+		return i<items.size() ? items[i] : null();
+	}
+	size_t size() const { return type==ARRAY ? items.size() : fields.size(); }
+	bool isNull() const { return type==NUL; }
+	const char* str(const char* missing="") const
+	{
+		return type==STRING ? s.c_str() : missing;
+	}
+
+	// Parse text into this, false if it isn't JSON
+	bool parse(const char* text, size_t length)
+	{
+		const char* p = text;
+		const char* e = text + length;
+		*this = JSON();
+		if(!value(p, e, *this, 0)) return false;
+		space(p, e);
+		return p==e;
+	}
+	bool parse(const std::string& text){ return parse(text.data(), text.size()); }
+
+protected:
+	static const JSON& null()
+	{
+		static const JSON nothing;
+		return nothing;
+	}
+	static void space(const char*& p, const char* e)
+	{
+		while(p<e && (*p==' ' || *p=='\t' || *p=='\n' || *p=='\r'))
+			++p;
+	}
+	static bool word(const char*& p, const char* e, const char* w)
+	{
+		size_t n = strlen(w);
+		if(size_t(e-p)<n || memcmp(p, w, n)!=0) return false;
+		p += n;
+		return true;
+	}
+	static bool value(const char*& p, const char* e, JSON& out, int depth)
+	{
+		if(depth>64) return false;			// don't let it blow the stack
+		space(p, e);
+		if(p>=e) return false;
+		switch(*p){
+		case '{':
+			out.type = OBJECT;
+			++p;
+			space(p, e);
+			if(p<e && *p=='}'){ ++p; return true; }
+			for(;;){
+				std::pair<std::string, JSON> f;
+				space(p, e);
+				if(!string(p, e, f.first)) return false;
+				space(p, e);
+				if(p>=e || *p++!=':') return false;
+				if(!value(p, e, f.second, depth+1)) return false;
+				out.fields.push_back(std::move(f));
+				space(p, e);
+				if(p<e && *p==','){ ++p; continue; }
+				if(p<e && *p=='}'){ ++p; return true; }
+				return false;
+			}
+		case '[':
+			out.type = ARRAY;
+			++p;
+			space(p, e);
+			if(p<e && *p==']'){ ++p; return true; }
+			for(;;){
+				out.items.emplace_back();
+				if(!value(p, e, out.items.back(), depth+1)) return false;
+				space(p, e);
+				if(p<e && *p==','){ ++p; continue; }
+				if(p<e && *p==']'){ ++p; return true; }
+				return false;
+			}
+		case '"':
+			out.type = STRING;
+			return string(p, e, out.s);
+		case 't':
+			out.type = BOOL;
+			out.b = true;
+			return word(p, e, "true");
+		case 'f':
+			out.type = BOOL;
+			return word(p, e, "false");
+		case 'n':
+			return word(p, e, "null");
+		default:
+			{
+				char temp[64];
+				size_t n = 0;
+				while(p+n<e && n<sizeof(temp)-1 && strchr("+-0123456789.eE", p[n]))
+					temp[n] = p[n], ++n;
+				if(n==0) return false;
+				temp[n] = 0;
+				char* end;
+				out.type = NUMBER;
+				out.n = strtod(temp, &end);
+				p += n;
+				return end==temp+n;
+			}
+		}
+	}
+	static int hex(const char*& p, const char* e)
+	{
+		if(e-p<4) return -1;
+		int v = 0;
+		for(int i=0; i<4; ++i, ++p){
+			char c = *p;
+			v <<= 4;
+			if(c>='0' && c<='9')		v |= c-'0';
+			else if(c>='a' && c<='f')	v |= c-'a'+10;
+			else if(c>='A' && c<='F')	v |= c-'A'+10;
+			else return -1;
+		}
+		return v;
+	}
+	static void utf8(std::string& out, unsigned c)
+	{
+		if(c<0x80) out += char(c);
+		else if(c<0x800){
+			out += char(0xc0 | c>>6);
+			out += char(0x80 | (c & 0x3f));
+		}
+		else if(c<0x10000){
+			out += char(0xe0 | c>>12);
+			out += char(0x80 | (c>>6 & 0x3f));
+			out += char(0x80 | (c & 0x3f));
+		}
+		else{
+			out += char(0xf0 | c>>18);
+			out += char(0x80 | (c>>12 & 0x3f));
+			out += char(0x80 | (c>>6 & 0x3f));
+			out += char(0x80 | (c & 0x3f));
+		}
+	}
+	static bool string(const char*& p, const char* e, std::string& out)
+	{
+		if(p>=e || *p++!='"') return false;
+		while(p<e && *p!='"'){
+			if(*p!='\\'){
+				out += *p++;
+				continue;
+			}
+			if(++p>=e) return false;
+			char c = *p++;
+			switch(c){
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u':
+				{
+					int u = hex(p, e);
+					if(u<0) return false;
+					if(u>=0xd800 && u<0xdc00 && e-p>=6 && p[0]=='\\' && p[1]=='u'){
+						p += 2;				// a surrogate pair
+						int lo = hex(p, e);
+						if(lo<0xdc00 || lo>0xdfff) return false;
+						u = 0x10000 + ((u-0xd800)<<10) + (lo-0xdc00);
+					}
+					utf8(out, u);
+				}
+				break;
+			default:  out += c; break;		// \" \\ and \/
+			}
+		}
+		if(p>=e) return false;
+		++p;								// the closing "
+		return true;
+	}
+};
@@ -0,0 +1,87 @@
+//==============================================================================
+// label.h		A Gtk::Label that only repaints when it has to
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// Gtk::Label::set_text() invalidates and repaints the whole label even if the
+// text is the same as last time and set_name() restyles it even if the name
+// is the same. LABEL remembers what it was last given and does nothing if
+// nothing changed. The same goes for a CSS class.
+//
+// fix() sets the size from the font metrics of the widest text it will ever
+// show so a new text can't make it grow or shrink. GtkLabel still queues a
+// resize on every set_text() so anything that changes every second should be
+// a GLYPHS instead (see glyphs.h).
+//
+// DAMAGE adds up the area we have asked GTK to repaint so -d can report it.
+//
+//==============================================================================
+
+#pragma once
+
+#include <gtkmm/label.h>
+#include <cstring>
+
+struct DAMAGE {
+	inline static long pixels{0};			// since the last report
+
+	static void add(int width, int height){ pixels += long(width)*height; }
+};
+
+class LABEL : public Gtk::Label {
+protected:
+	char shown[200]{};						// the text on the screen
+	char style[20]{};						// the CSS name in use
+	char cls[20]{};							// and CSS class
+	const char* widest{nullptr};			// for fix()
+
+public:
+	// Returns true if it changed
+	bool set(const char* text)
+	{
+		if(strncmp(text, shown, sizeof(shown)-1)==0)
+			return false;
+		strncpy(shown, text, sizeof(shown)-1);
+		DAMAGE::add(get_allocated_width(), get_allocated_height());
+		gtk_label_set_text(gobj(), text);	// no Glib::ustring in the way
+		return true;
+	}
+
+	// Lock the size to fit this text with the current font
+	void fix(const char* text)
+	{
+		widest = text;
+		int w, h;
+		create_pango_layout(widest)->get_pixel_size(w, h);
+		set_size_request(w, h);
+	}
+
+	// The CSS name and class (eg: which calendar), "" for no class
+	void name(const char* css, const char* c="")
+	{
+		if(strncmp(css, style, sizeof(style)-1)!=0){
+			strncpy(style, css, sizeof(style)-1);
+			DAMAGE::add(get_allocated_width(), get_allocated_height());
+			set_name(css);
+		}
+		if(strncmp(c, cls, sizeof(cls)-1)==0)
+			return;
+		if(cls[0])
+			get_style_context()->remove_class(cls);
+		strncpy(cls, c, sizeof(cls)-1);
+		if(cls[0])
+			get_style_context()->add_class(cls);
+		DAMAGE::add(get_allocated_width(), get_allocated_height());
+	}
+
+protected:
+	// The font may have changed so measure again
+	void on_style_updated() override
+	{
+		Gtk::Label::on_style_updated();
+		if(widest)
+			fix(widest);
+	}
+};
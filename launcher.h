@@ -0,0 +1,228 @@
+//==============================================================================
+// launcher.h	Run a helper program and keep an eye on it
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// The old way was fork() and then system("python clock.py 2> ...") which
+// copies the whole GTK process, starts a shell just to start python and never
+// waits for anything so we left a zombie every hour.
+//
+// LAUNCHER uses posix_spawnp() to start the program directly (no shell) in
+// its own directory with stderr sent to a file. Glib's child watch reaps it
+// from the main loop when it finishes so we never block, and a timer kills it
+// (the whole process group) if it takes too long. When it is all over the
+// callback gets a RESULT with how it ended and how long it took.
+//
+// With bPipes its stdin and stdout are pipes to us (toChild and fromChild)
+// for helpers that stay running and take requests. A timeout of 0 means it
+// can run for as long as it likes.
+//
+// Starting it in 'dir' needs posix_spawn_file_actions_addchdir_np() which
+// came in glibc 2.29. Raspberry Pi OS Buster has 2.28 so there a shell does
+// the cd and then exec's the program, which costs a few mS each start.
+//
+//==============================================================================
+
+#pragma once
+
+#include <glibmm/main.h>
+#include <spawn.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <string.h>
+#include <stdio.h>
+#include <functional>
+#include <vector>
+
+extern char** environ;
+
+struct RESULT {
+	bool	bStarted{false};				// false if we couldn't run it at all
+	bool	bTimedOut{false};				// we killed it
+	int		status{0};						// from waitpid()
+	double	seconds{0};						// how long it ran
+
+	bool ok() const
+	{
+		return bStarted && !bTimedOut && WIFEXITED(status)
+											&& WEXITSTATUS(status)==0;
+	}
+	// A few words for the screen
+	void text(char* out, int size, const char* what) const
+	{
+		if(!bStarted)
+			snprintf(out, size, "%s failed to start", what);
+		else if(bTimedOut)
+			snprintf(out, size, "%s killed after %.0fS", what, seconds);
+		else if(WIFSIGNALED(status))
+			snprintf(out, size, "%s died of signal %d after %.1fS", what,
+											WTERMSIG(status), seconds);
+		else
+			snprintf(out, size, "%s exit %d in %.1fS", what,
+											WEXITSTATUS(status), seconds);
+	}
+};
+
+class LAUNCHER {
+protected:
+	pid_t	pid{0};							// 0 when nothing is running
+	double	started{0};
+	bool	bTimedOut{false};
+	sigc::connection watch, timer;
+	std::function<void(const RESULT&)> onDone;
+
+public:
+	int		toChild{-1}, fromChild{-1};		// the pipes if we asked for them
+
+	LAUNCHER() = default;
+	LAUNCHER(const LAUNCHER&) = delete;
+	virtual ~LAUNCHER()
+	{
+		watch.disconnect();
+		timer.disconnect();
+		if(pid>0) kill(-pid, SIGKILL);		// don't leave it behind
+		closePipes();
+	}
+
+	bool running() const { return pid>0; }
+
+	// Start argv[0] (found on the PATH) in dir with stderr going to errFile.
+	// Returns false if it can't be started, done() is called either way.
+	bool start(const char* dir, const char* const argv[], const char* errFile,
+				int timeout, std::function<void(const RESULT&)> done,
+				bool bPipes=false)
+	{
+		if(running()) return false;
+		onDone = done;
+		bTimedOut = false;
+		closePipes();
+
+		// our ends are close-on-exec, the child's get dup2()ed into place
+		int in[2]{-1,-1}, out[2]{-1,-1};
+		if(bPipes && (pipe2(in, O_CLOEXEC)<0 || pipe2(out, O_CLOEXEC)<0)){
+			perror("launcher: pipe");
+			for(int fd : { in[0], in[1], out[0], out[1] })
+				if(fd>=0)					// the first may have worked
+					close(fd);
+			onDone(RESULT());
+			return false;
+		}
+
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 29)
+		// sh -c 'cd "$0" && exec "$@"' dir argv... so nothing needs quoting
+		std::vector<const char*> viaShell = { "sh", "-c",
+											  "cd \"$0\" && exec \"$@\"", dir };
+		for(int i=0; argv[i]; ++i)
+			viaShell.push_back(argv[i]);
+		viaShell.push_back(nullptr);
+		argv = viaShell.data();
+#else
+		posix_spawn_file_actions_addchdir_np(&actions, dir);
+#endif
+		if(bPipes){
+			posix_spawn_file_actions_adddup2(&actions, in[0], 0);
+			posix_spawn_file_actions_adddup2(&actions, out[1], 1);
+		}
+		else
+			posix_spawn_file_actions_addopen(&actions, 0, "/dev/null",
+																O_RDONLY, 0);
+		posix_spawn_file_actions_addopen(&actions, 2, errFile,
+									O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+		// its own process group so we can kill anything it starts too and
+		// normal signal handling whatever GTK has done to ours
+		posix_spawnattr_t attr;
+		posix_spawnattr_init(&attr);
+		sigset_t none, all;
+		sigemptyset(&none);
+		sigfillset(&all);
+		posix_spawnattr_setsigmask(&attr, &none);
+		posix_spawnattr_setsigdefault(&attr, &all);
+		posix_spawnattr_setpgroup(&attr, 0);
+		posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP
+							| POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+		int error = posix_spawnp(&pid, argv[0], &actions, &attr,
+									const_cast<char* const*>(argv), environ);
+		posix_spawn_file_actions_destroy(&actions);
+		posix_spawnattr_destroy(&attr);
+		if(bPipes){							// keep just our ends
+			close(in[0]);
+			close(out[1]);
+			toChild = in[1];
+			fromChild = out[0];
+			fcntl(fromChild, F_SETFL, O_NONBLOCK);
+		}
+		if(error){
+			fprintf(stderr, "launcher: %s: %s\n", argv[0], strerror(error));
+			pid = 0;
+			closePipes();
+			onDone(RESULT());
+			return false;
+		}
+		started = now();
+
+		// Glib reaps it for us when it finishes...
+		watch = Glib::signal_child_watch().connect(
+					[this](Glib::Pid, int status){ finished(status); }, pid);
+		// ...and if it doesn't we kill it
+		if(timeout>0)
+			timer = Glib::signal_timeout().connect_seconds(
+						[this]{ return expired(); }, timeout);
+		return true;
+	}
+
+	// Give up on it now
+	void stop()
+	{
+		if(pid>0 && !bTimedOut)
+			expired();
+	}
+
+	void closePipes()
+	{
+		if(toChild>=0)   close(toChild);
+		if(fromChild>=0) close(fromChild);
+		toChild = fromChild = -1;
+	}
+
+protected:
+	static double now()
+	{
+		timespec t;
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		return t.tv_sec + t.tv_nsec/1e9;
+	}
+
+	// Ask nicely and then not so nicely
+	bool expired()
+	{
+		timer.disconnect();
+		if(pid<=0) return false;
+		kill(-pid, bTimedOut ? SIGKILL : SIGTERM);
+		bTimedOut = true;
+		timer = Glib::signal_timeout().connect_seconds(
+					[this]{ return expired(); }, 5);
+		return false;
+	}
+
+	void finished(int status)
+	{
+		timer.disconnect();
+		RESULT r;
+		r.bStarted = true;
+		r.bTimedOut = bTimedOut;
+		r.status = status;
+		r.seconds = now() - started;
+		pid = 0;
+		closePipes();
+		onDone(r);
+	}
+};
@@ -0,0 +1,52 @@
+//==============================================================================
+// merge.h		Merge lists that are already in order into one
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// Each calendar comes back from Google sorted by start time. To get the next
+// events from all of them we don't need to throw them together and sort the
+// lot, just keep a heap of where we are in each list with the earliest on top
+// and take from there. That is k-way merging: taking one is log k (the number
+// of lists) and it can stop as soon as it has enough. Equal ones come out in
+// list order so the first calendar wins a tie.
+//
+//==============================================================================
+
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+// Call out(item) with the first n from 'lists' in order, less(a,b) says if a
+// comes before b and each list must already be in that order. Returns how
+// many went out.
+template<class T, class LESS, class F>
+size_t kmerge(const std::vector<std::vector<T>>& lists, LESS less, size_t n, F out)
+{
+	typedef std::pair<size_t, size_t> AT;	// which list and where in it
+	auto after = [&](const AT& a, const AT& b){
+		const T& x = lists[a.first][a.second];
+		const T& y = lists[b.first][b.second];
+		return less(y, x) || (!less(x, y) && b.first<a.first);
+	};
+	std::vector<AT> heap;					// the next of each list
+	for(size_t i=0; i<lists.size(); ++i)
+		if(!lists[i].empty())
+			heap.push_back(AT(i, 0));
+	std::make_heap(heap.begin(), heap.end(), after);
+	size_t done = 0;
+	while(!heap.empty() && done<n){
+		std::pop_heap(heap.begin(), heap.end(), after);
+		AT& at = heap.back();
+		out(lists[at.first][at.second]);
+		++done;
+		if(++at.second<lists[at.first].size())
+			std::push_heap(heap.begin(), heap.end(), after);
+		else
+			heap.pop_back();
+	}
+	return done;
+}
@@ -0,0 +1,98 @@
+"""A pretend Google for trying 'clock -u' with no network.
+
+    python mockcal.py [port] [--chunked] [--revoked]
+    ./clock -u http://localhost:8080
+
+It answers the token refresh at /token and the events list at
+/calendar/v3/calendars/<id>/events over HTTP/1.1 with keep-alive, gzips
+when asked and prints each request so you can see the connection reused.
+Any calendar id works (put some in calendars.txt), each gets its own events.
+--chunked sends the events with chunked encoding, --revoked turns down the
+refresh token the way Google does so the clock shows the token instructions.
+"""
+
+import datetime
+import gzip
+import json
+import sys
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import urlparse, parse_qs, unquote
+
+CHUNKED = '--chunked' in sys.argv
+REVOKED = '--revoked' in sys.argv
+TOKEN = 'mock-access-token'
+
+
+def events(count, calendar='primary'):
+    """Some events starting from today, like events.list with fields= gives.
+    Other calendars than primary have theirs a few hours later."""
+    today = datetime.date.today()
+    late = 0 if calendar == 'primary' else 1 + sum(map(ord, calendar)) % 5
+    items = [{'id': 'bins', 'start': {'date': today.isoformat()},
+              'end': {'date': (today + datetime.timedelta(days=1)).isoformat()},
+              'summary': 'Bins out'}] if calendar == 'primary' else []
+    for i in range(1, count):
+        day = today + datetime.timedelta(days=i // 2)
+        hour = (9 + i % 2 * 4 + late) % 24
+        items.append({'id': '%s%d' % (calendar, i),
+                      'start': {'dateTime': '%sT%02d:30:00+01:00'
+                                % (day.isoformat(), hour)},
+                      'end': {'dateTime': '%sT%02d:59:00+01:00'
+                              % (day.isoformat(), hour)},
+                      'summary': '%s event %d é☺' % (calendar.split('@')[0], i)})
+    return {'items': items}
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'       # keep-alive
+
+    def reply(self, status, body, chunked=False):
+        data = json.dumps(body).encode()
+        self.send_response(status)
+        self.send_header('Content-Type', 'application/json; charset=UTF-8')
+        if 'gzip' in self.headers.get('Accept-Encoding', ''):
+            data = gzip.compress(data)
+            self.send_header('Content-Encoding', 'gzip')
+        if chunked:
+            self.send_header('Transfer-Encoding', 'chunked')
+            self.end_headers()
+            for i in range(0, len(data), 100):
+                part = data[i:i + 100]
+                self.wfile.write(b'%x\r\n%s\r\n' % (len(part), part))
+            self.wfile.write(b'0\r\n\r\n')
+        else:
+            self.send_header('Content-Length', str(len(data)))
+            self.end_headers()
+            self.wfile.write(data)
+
+    def do_POST(self):
+        form = parse_qs(self.rfile.read(
+            int(self.headers.get('Content-Length', 0))).decode())
+        if urlparse(self.path).path != '/token':
+            self.reply(404, {'error': 'not_found'})
+        elif REVOKED or 'refresh_token' not in form:
+            self.reply(400, {'error': 'invalid_grant',
+                             'error_description': 'Token has been expired or revoked.'})
+        else:
+            self.reply(200, {'access_token': TOKEN, 'expires_in': 3599,
+                             'token_type': 'Bearer'})
+
+    def do_GET(self):
+        url = urlparse(self.path)
+        query = parse_qs(url.query)
+        parts = url.path.split('/')     # '', calendar, v3, calendars, id, events
+        if len(parts) != 6 or parts[1:4] != ['calendar', 'v3', 'calendars'] \
+                or parts[5] != 'events':
+            self.reply(404, {'error': {'code': 404, 'message': 'Not Found'}})
+        elif self.headers.get('Authorization') != 'Bearer ' + TOKEN:
+            self.reply(401, {'error': {'code': 401, 'message': 'Invalid Credentials'}})
+        else:
+            self.reply(200, events(int(query.get('maxResults', ['10'])[0]),
+                                   unquote(parts[4])), CHUNKED)
+
+
+if __name__ == '__main__':
+    ports = [a for a in sys.argv[1:] if a.isdigit()]
+    port = int(ports[0]) if ports else 8080
+    print('mock calendar on http://localhost:%d' % port, flush=True)
+    ThreadingHTTPServer(('localhost', port), Handler).serve_forever()
@@ -0,0 +1,175 @@
+//==============================================================================
+// nextn.h		Keep the first N events from a stream of any size
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// clock.py sorts the events before writing them so setCalendar() just took
+// the first five lines. A shared team calendar or an exported .ics file can
+// have thousands of entries in any order and we don't want them all in
+// memory to sort them when we are only going to show five.
+//
+// NEXTN keeps the N earliest (that haven't finished by 'after') in a heap
+// with the latest of them on top. Each new one is compared with the top: if it
+// is later it is thrown away straight away, if not it replaces the top. So
+// the memory is N events however many go past and each costs at most log N.
+// The strings of a replaced event are reused so once it is full a stream of
+// events doesn't touch the heap either.
+//
+// read() streams events.txt style lines from a file descriptor
+//		2022-10-13T12:00:00+01:00 Lunch with Robin
+//		* something bad happened
+// through a fixed buffer so a file of any size goes through in the same
+// memory ('clock -b nextn' feeds it a gigabyte).
+//
+//==============================================================================
+
+#pragma once
+
+#include "zone.h"
+#include "rfc3339.h"
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+class NEXTN {
+public:
+	struct ITEM {
+		int64_t		start{0};				// UTC seconds
+		int64_t		end{0};
+		bool		bAllDay{false};
+		int			calendar{0};
+		std::string	when;					// the start as it was written
+		std::string	summary;
+		std::string	id;
+	};
+
+	size_t	n;								// how many we keep
+	int64_t	after;							// drop those finished by then
+	long	seen{0};						// offered, for the statistics
+
+protected:
+	std::vector<ITEM> heap;					// the latest on top
+	bool	bSorted{false};					// or in order after sorted()
+	static bool earlier(const ITEM& a, const ITEM& b){ return a.start<b.start; }
+
+public:
+	NEXTN(size_t n, int64_t after=INT64_MIN) : n(n), after(after)
+	{
+		heap.reserve(n);
+	}
+
+	void clear()		{ heap.clear(); seen = 0; bSorted = false; }
+	size_t size() const	{ return heap.size(); }
+
+	// The latest start we are keeping, anything after it is no use once full
+	int64_t last() const
+	{
+		return heap.size()<n || n==0 ? INT64_MAX : bSorted ? heap.back().start
+														   : heap.front().start;
+	}
+
+	// One more event, false if it didn't make the cut
+	bool offer(int64_t start, int64_t end, bool bAllDay, std::string_view when,
+			   std::string_view summary, std::string_view id={}, int calendar=0)
+	{
+		++seen;
+		if(end<=after || n==0)
+			return false;
+		if(bSorted){						// back to a heap
+			std::make_heap(heap.begin(), heap.end(), earlier);
+			bSorted = false;
+		}
+		if(heap.size()==n){
+			if(start>=heap.front().start)
+				return false;
+			std::pop_heap(heap.begin(), heap.end(), earlier);	// top to the back
+		}
+		else
+			heap.emplace_back();
+		ITEM& e = heap.back();
+		e.start    = start;
+		e.end      = end;
+		e.bAllDay  = bAllDay;
+		e.calendar = calendar;
+		e.when.assign(when.data(), when.size());
+		e.summary.assign(summary.data(), summary.size());
+		e.id.assign(id.data(), id.size());
+		std::push_heap(heap.begin(), heap.end(), earlier);
+		return true;
+	}
+
+	// What we kept in start order, offer() makes it a heap again
+	const std::vector<ITEM>& sorted()
+	{
+		if(!bSorted)
+			std::sort_heap(heap.begin(), heap.end(), earlier);
+		bSorted = true;
+		return heap;
+	}
+
+	// Take a file of lines like events.txt a buffer at a time, offer the
+	// events and keep the first maxErrors of the '*' lines (and lines we can't
+	// read) in order. The lines have no end so an all day event is taken to
+	// last the day and a timed one to be over once it starts, that way the
+	// ones in the past are dropped. Returns false on a read error.
+	bool read(int fd, ZONE& zone, std::vector<std::string>& errors,
+												size_t maxErrors=5)
+	{
+		std::vector<char> buffer(1<<16);
+		size_t used = 0;
+		bool bSkip = false;					// the rest of an overlong line
+		for(;;){
+			ssize_t got = ::read(fd, buffer.data()+used, buffer.size()-used);
+			if(got<0 && errno==EINTR) continue;
+			if(got<0) return false;
+			if(got==0){						// the last line may have no \n
+				if(used && !bSkip)
+					line(buffer.data(), used, zone, errors, maxErrors);
+				return true;
+			}
+			used += got;
+			char* p = buffer.data();
+			char* end = p + used;
+			char* eol;
+			while((eol = (char*)memchr(p, '\n', end-p))!=nullptr){
+				if(!bSkip)
+					line(p, eol-p, zone, errors, maxErrors);
+				bSkip = false;
+				p = eol+1;
+			}
+			used = end-p;
+			if(used==buffer.size()){		// no \n in 64K, take what we have
+				line(p, used, zone, errors, maxErrors);
+				bSkip = true;
+				used = 0;
+			}
+			memmove(buffer.data(), p, used);
+		}
+	}
+
+protected:
+	void line(const char* p, size_t len, ZONE& zone,
+				std::vector<std::string>& errors, size_t maxErrors)
+	{
+		if(len && p[len-1]=='\r') --len;
+		if(len==0) return;
+		const char* space = (const char*)memchr(p, ' ', len);
+		RFC3339 t;
+		if(p[0]=='*' || !space || !t.parse(p, space-p)){
+			if(errors.size()<maxErrors)
+				errors.emplace_back(p, len);
+			return;
+		}
+		int64_t start = t.local(zone);
+		offer(start, t.bDate ? start+86400 : start, t.bDate,
+				std::string_view(p, space-p),
+				std::string_view(space+1, p+len-space-1));
+	}
+};
@@ -0,0 +1,119 @@
+//==============================================================================
+// rfc3339.h	Read Google's time stamps properly
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// Google sends times in RFC 3339 form
+//		2022-10-13T12:00:00+01:00		2022-11-01T21:00:00Z
+//		2022-10-13T12:00:00.500-04:30	2022-10-13 (an all day event)
+// The old code took the characters at fixed columns so it went wrong with a
+// fraction or a '-' offset and showed the time where the event was written,
+// not here. RFC3339::parse() reads the lot into UTC seconds and the offset,
+// then ZONE turns UTC into our local time like everything else.
+//
+// Each field is at a fixed place so the digits are turned into numbers
+// without tests and any non-digit or bad value just sets a bit in 'bad'
+// which we look at once at the end. That keeps it quick ('clock -b rfc3339'
+// does a million) and fuzz/rfc3339.cpp throws rubbish at it.
+//
+// Not quite the RFC: a missing offset is taken as UTC (token.json's expiry
+// has none) and second 60 just rolls into the next minute.
+//
+//==============================================================================
+
+#pragma once
+
+#include "zone.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+struct RFC3339 {
+	int64_t	utc{0};							// seconds since 1970 UTC
+	int		offset{0};						// seconds east as it was written
+	bool	bDate{false};					// just a date, see local()
+
+	// Read s[0..n), false if it isn't a time stamp
+	bool parse(const char* s, size_t n)
+	{
+		if(n<10) return false;
+		unsigned bad = 0;
+		int y  = digits(s, 4, bad);
+		int m  = digits(s+5, 2, bad);
+		int d  = digits(s+8, 2, bad);
+		bad |= (s[4]!='-') | (s[7]!='-');
+		bad |= (unsigned(m-1)>11) | (unsigned(d-1)>=unsigned(mdays(y, m)));
+		if(bad) return false;
+		int64_t day = ZONE::days(y, m, d);
+		offset = 0;
+		if(n==10){							// a date, midnight somewhere
+			utc = day*86400;
+			bDate = true;
+			return true;
+		}
+		bDate = false;
+		if(n<19) return false;
+		int hh = digits(s+11, 2, bad);
+		int mm = digits(s+14, 2, bad);
+		int ss = digits(s+17, 2, bad);
+		bad |= ((s[10] | 0x20)!='t' && s[10]!=' ') | (s[13]!=':') | (s[16]!=':');
+		bad |= (hh>23) | (mm>59) | (ss>60);
+		size_t p = 19;
+		if(p<n && s[p]=='.'){				// fractions, any number of digits
+			size_t first = ++p;
+			while(p<n && unsigned(s[p]-'0')<=9) ++p;
+			bad |= p==first;
+		}
+		if(p<n){
+			char z = s[p] | 0x20;			// 'z' or 'Z'
+			if(z=='z')
+				bad |= p+1!=n;
+			else if(s[p]=='+' || s[p]=='-'){
+				bad |= p+6!=n;
+				if(p+6<=n){
+					int oh = digits(s+p+1, 2, bad);
+					int om = digits(s+p+4, 2, bad);
+					bad |= (s[p+3]!=':') | (oh>23) | (om>59);
+					offset = (s[p]=='-' ? -60 : 60) * (oh*60 + om);
+				}
+			}
+			else
+				bad = 1;
+		}
+		utc = day*86400 + hh*3600 + mm*60 + ss - offset;
+		return !bad;
+	}
+	bool parse(const char* s){ return parse(s, strlen(s)); }
+
+	// When it happens by our clock. An all day event is a date not a moment
+	// so it starts at our local midnight whatever our offset is.
+	int64_t local(ZONE& zone) const
+	{
+		if(!bDate) return utc;
+		tm t;
+		zone.local(utc, &t);				// the offset about then
+		int64_t guess = utc - t.tm_gmtoff;
+		zone.local(guess, &t);				// and again in case that crossed
+		return utc - t.tm_gmtoff;			// a change
+	}
+
+protected:
+	static int digits(const char* s, int n, unsigned& bad)
+	{
+		int v = 0;
+		for(int i=0; i<n; ++i){
+			unsigned c = unsigned(s[i]) - '0';
+			bad |= c>9;
+			v = v*10 + int(c);
+		}
+		return v;
+	}
+	static int mdays(int y, int m)
+	{
+		static const unsigned char table[13] = { 31, 31,28,31,30,31,30,31,31,30,31,30,31 };
+		bool leap = (y%4==0) & ((y%100!=0) | (y%400==0));
+		return table[unsigned(m)<=12 ? m : 0] + (m==2 && leap);
+	}
+};
@@ -0,0 +1,120 @@
+//==============================================================================
+// schedule.h	Work out when to fetch the calendar next
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// A fixed hour between fetches is too slow just before a meeting (when it is
+// most likely to be moved) and a waste at three in the morning. SCHEDULE
+// starts from 'base' and then:
+//	-	doubles it (up to 'longest') for each fetch in a row that brought back
+//		exactly what we had, a quiet calendar gets left alone
+//	-	waits 'longest' overnight
+//	-	goes every 'soonest' for half an hour after Refresh is pressed and when
+//		the next event is less than half an hour away, and otherwise makes sure
+//		there is a fetch ten minutes before it starts
+//	-	fetches just after midnight so the new day is right
+//	-	never goes over 'budget' fetches in a local day, once they are used up
+//		the next one is after midnight
+// plan() says how long to wait and keeps the reason so -d can show it.
+//
+//==============================================================================
+
+#pragma once
+
+#include "zone.h"
+#include <time.h>
+#include <algorithm>
+
+class SCHEDULE {
+public:
+	int		base{15*60};					// seconds between fetches normally
+	int		soonest{5*60};					// when things are happening
+	int		longest{2*3600};				// when they aren't
+	int		budget{150};					// fetches a day at most
+
+	int		used{0};						// fetches today
+	int		same{0};						// unchanged answers in a row
+	const char* reason{"first"};			// why plan() chose what it did
+
+protected:
+	int64_t	day{-1};						// local day 'used' counts for
+	time_t	pressed{0};						// Refresh was pressed
+
+public:
+	// Somebody pressed Refresh
+	void refresh(time_t now)	{ pressed = now; }
+
+	// A fetch came back, did it change anything?
+	void fetched(bool bChanged)	{ same = bChanged ? 0 : same+1; }
+
+	// Count a fetch, false if today's budget has gone
+	bool spend(time_t now, ZONE& zone)
+	{
+		tm t;
+		zone.local(now, &t);
+		newDay(t);
+		if(used>=budget) return false;
+		++used;
+		return true;
+	}
+
+	// Seconds until the next fetch given the start of the next event (0 for
+	// none) and set 'reason'
+	int plan(time_t now, time_t nextEvent, ZONE& zone)
+	{
+		tm t;
+		zone.local(now, &t);
+		newDay(t);
+		int midnight = 86400 - (t.tm_hour*3600 + t.tm_min*60 + t.tm_sec);
+
+		int wait = base << std::min(same, 4);
+		reason = same ? "unchanged" : "normal";
+		if(wait>=longest){
+			wait = longest;
+			reason = "quiet";
+		}
+		if(t.tm_hour>=1 && t.tm_hour<6){
+			wait = longest;
+			reason = "overnight";
+		}
+		if(now-pressed<30*60 && wait>soonest){
+			wait = soonest;
+			reason = "after Refresh";
+		}
+		if(nextEvent>now){
+			int lead = int(std::min<time_t>(nextEvent-now, 86400));
+			if(lead<=30*60){
+				if(wait>soonest){
+					wait = soonest;
+					reason = "event soon";
+				}
+			}
+			else if(lead-10*60<wait){
+				wait = lead-10*60;
+				reason = "before next event";
+			}
+		}
+		if(midnight<wait){
+			wait = midnight + 60;
+			reason = "after midnight";
+		}
+		if(used>=budget){
+			wait = midnight + 60;
+			reason = "budget used";
+		}
+		return std::max(wait, 60);
+	}
+
+protected:
+	// The budget starts again each local day
+	void newDay(const tm& t)
+	{
+		int64_t today = ZONE::days(t.tm_year+1900, t.tm_mon+1, t.tm_mday);
+		if(today!=day){
+			day = today;
+			used = 0;
+		}
+	}
+};
@@ -0,0 +1,275 @@
+//==============================================================================
+// snapshot.h	The events as a binary file we can map and read in place
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// events.txt had to be picked apart by column numbers and only had the start
+// and the summary. events.bin is written by the fetcher (clock.py or gcal.h)
+// and we mmap() it so reading an event is just looking at the memory, there
+// is nothing to parse and nothing to copy.
+//
+// The layout (all little endian, which the Pi is):
+//	HEAD		32 bytes, magic "PCLK", version and where everything is
+//	EVENT[]		count of them each recordSize bytes, sorted by start
+//	strings		NUL terminated UTF-8, an EVENT holds offsets into here.
+//				Offset 0 is always "" and the same string is only kept once.
+//
+// A newer version may make HEAD or EVENT longer (hence headSize and
+// recordSize) but only adds fields on the end so this code can still read
+// it. A different major version or anything that doesn't add up is refused.
+//
+// The fetcher writes a new file and renames it over the old one, and only if
+// it has changed so an hourly fetch of the same calendar doesn't wear out the
+// SD card (it just touches it so the time says when it was last good). Our
+// mapping is of the old file so that stays good until we let go. It is also
+// what we show at startup before the first fetch.
+//
+// 'clock -x [file]' prints one out as text for debugging.
+//
+//==============================================================================
+
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <utime.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+static_assert(__BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__, "events.bin is little endian");
+
+struct SNAPHEAD {
+	char		magic[4];					// "PCLK"
+	uint16_t	version;					// major, bump to break readers
+	uint16_t	headSize;					// sizeof(SNAPHEAD) when written
+	uint16_t	recordSize;					// sizeof(SNAPEVENT) when written
+	uint16_t	reserved;
+	uint32_t	count;						// events
+	uint32_t	strings;					// where the strings start
+	uint32_t	stringSize;					// and how many bytes
+	uint32_t	spare[2];
+};
+
+struct SNAPEVENT {
+	int64_t		start, end;					// UTC seconds
+	uint32_t	when;						// the start as Google sent it
+	uint32_t	summary;
+	uint32_t	id;							// Google's event id
+	uint16_t	flags;						// ALLDAY
+	uint16_t	calendar;					// which calendar (0 for now)
+
+	enum { ALLDAY=1 };
+};
+
+static_assert(sizeof(SNAPHEAD)==32 && sizeof(SNAPEVENT)==32, "fixed sizes");
+
+class SNAPSHOT {
+protected:
+	void*	base{MAP_FAILED};
+	size_t	size{0};
+	const SNAPHEAD* head{nullptr};
+	time_t	mtime{0};
+
+public:
+	enum { VERSION=1 };
+
+	SNAPSHOT() = default;
+	SNAPSHOT(const SNAPSHOT&) = delete;
+	virtual ~SNAPSHOT(){ unmap(); }
+
+	// Map a file, false (and empty) if it isn't there or isn't right
+	bool map(const char* path)
+	{
+		unmap();
+		int fd = open(path, O_RDONLY | O_CLOEXEC);
+		if(fd<0) return false;
+		struct stat st;
+		if(fstat(fd, &st)==0 && st.st_size>=(off_t)sizeof(SNAPHEAD)){
+			size = st.st_size;
+			mtime = st.st_mtime;
+			base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+		close(fd);							// the mapping keeps it open
+		if(base==MAP_FAILED){
+			size = 0;
+			return false;
+		}
+		head = (const SNAPHEAD*)base;
+		if(!check()){
+			unmap();
+			return false;
+		}
+		return true;
+	}
+
+	void unmap()
+	{
+		if(base!=MAP_FAILED)
+			munmap(base, size);
+		base = MAP_FAILED;
+		size = 0;
+		head = nullptr;
+	}
+
+	bool valid() const		{ return head!=nullptr; }
+	time_t modified() const	{ return mtime; }		// last good fetch
+
+	// A fingerprint of the whole file (FNV-1a) to see if a fetch changed it
+	uint64_t hash() const
+	{
+		uint64_t h = 14695981039346656037ull;
+		const unsigned char* p = (const unsigned char*)base;
+		for(size_t i=0; head && i<size; ++i)
+			h = (h ^ p[i]) * 1099511628211ull;
+		return h;
+	}
+	uint32_t count() const	{ return head ? head->count : 0; }
+
+	// The i'th event, in place
+	const SNAPEVENT& operator[](uint32_t i) const
+	{
+		return *(const SNAPEVENT*)((const char*)base + head->headSize
+												+ size_t(i)*head->recordSize);
+	}
+	// A string from the string area, "" if the offset is silly
+	const char* text(uint32_t offset) const
+	{
+		if(!head || offset>=head->stringSize) return "";
+		return (const char*)base + head->strings + offset;
+	}
+
+	// 'clock -x' prints a file in the same shape as events.txt with the
+	// extra fields on the end
+	static int dump(const char* path)
+	{
+		SNAPSHOT s;
+		if(!s.map(path)){
+			fprintf(stderr, "%s: not an events snapshot\n", path);
+			return 1;
+		}
+		printf("# %s version %d, %u events, %u bytes of strings\n", path,
+					s.head->version, s.count(), s.head->stringSize);
+		for(uint32_t i=0; i<s.count(); ++i){
+			const SNAPEVENT& e = s[i];
+			char start[24], end[24];
+			tm t;
+			time_t st = e.start, en = e.end;
+			strftime(start, sizeof(start), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&st, &t));
+			strftime(end,   sizeof(end),   "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&en, &t));
+			printf("%s %s\t# %s..%s%s cal %d id %s\n", s.text(e.when),
+					s.text(e.summary), start, end,
+					e.flags & SNAPEVENT::ALLDAY ? " all day" : "",
+					e.calendar, s.text(e.id));
+		}
+		return 0;
+	}
+
+protected:
+	bool check() const
+	{
+		if(memcmp(head->magic, "PCLK", 4)!=0 || head->version!=VERSION)
+			return false;
+		if(head->headSize<sizeof(SNAPHEAD) || head->recordSize<sizeof(SNAPEVENT))
+			return false;
+		uint64_t records = head->headSize + uint64_t(head->count)*head->recordSize;
+		uint64_t strings = uint64_t(head->strings) + head->stringSize;
+		if(records>head->strings || strings>size || head->stringSize==0)
+			return false;
+		// the string area must end with a NUL so no string runs off the end
+		return ((const char*)base)[head->strings + head->stringSize - 1]==0;
+	}
+};
+
+// Build a snapshot and write it if it isn't what is there already
+class SNAPWRITER {
+protected:
+	std::vector<SNAPEVENT> events;
+	std::string strings{'\0'};				// offset 0 is ""
+	std::unordered_map<std::string, uint32_t> interned;
+
+public:
+	void add(int64_t start, int64_t end, bool bAllDay, const std::string& when,
+			 const std::string& summary, const std::string& id, int calendar=0)
+	{
+		SNAPEVENT e{};
+		e.start   = start;
+		e.end     = end;
+		e.when    = intern(when);
+		e.summary = intern(summary);
+		e.id      = intern(id);
+		e.flags   = bAllDay ? SNAPEVENT::ALLDAY : 0;
+		e.calendar = calendar;
+		events.push_back(e);
+	}
+	size_t count() const { return events.size(); }
+
+	// Write it to path (via path.new and a rename), false on failure.
+	// If the file already holds exactly this we leave it alone.
+	bool save(const char* path)
+	{
+		std::string bytes = build();
+		if(same(path, bytes))
+			return utime(path, nullptr)==0;	// just say it is still good
+		std::string temp = std::string(path) + ".new";
+		FILE* f = fopen(temp.c_str(), "wb");
+		if(!f) return false;
+		bool ok = fwrite(bytes.data(), 1, bytes.size(), f)==bytes.size();
+		ok = fflush(f)==0 && fsync(fileno(f))==0 && ok;
+		fclose(f);
+		if(!ok || rename(temp.c_str(), path)!=0){
+			unlink(temp.c_str());
+			return false;
+		}
+		return true;
+	}
+
+protected:
+	uint32_t intern(const std::string& s)
+	{
+		if(s.empty()) return 0;
+		auto found = interned.find(s);
+		if(found!=interned.end()) return found->second;
+		uint32_t offset = strings.size();
+		strings.append(s.c_str(), s.size()+1);	// with its NUL
+		interned[s] = offset;
+		return offset;
+	}
+
+	std::string build()
+	{
+		std::stable_sort(events.begin(), events.end(),
+			[](const SNAPEVENT& a, const SNAPEVENT& b){ return a.start<b.start; });
+		SNAPHEAD h{};
+		memcpy(h.magic, "PCLK", 4);
+		h.version    = SNAPSHOT::VERSION;
+		h.headSize   = sizeof(SNAPHEAD);
+		h.recordSize = sizeof(SNAPEVENT);
+		h.count      = events.size();
+		h.strings    = sizeof(SNAPHEAD) + events.size()*sizeof(SNAPEVENT);
+		h.stringSize = strings.size();
+		std::string bytes((const char*)&h, sizeof(h));
+		bytes.append((const char*)events.data(), events.size()*sizeof(SNAPEVENT));
+		bytes += strings;
+		return bytes;
+	}
+
+	static bool same(const char* path, const std::string& bytes)
+	{
+		FILE* f = fopen(path, "rb");
+		if(!f) return false;
+		std::string old(bytes.size()+1, '\0');	// +1 to spot a longer file
+		size_t n = fread(&old[0], 1, old.size(), f);
+		fclose(f);
+		return n==bytes.size() && memcmp(old.data(), bytes.data(), n)==0;
+	}
+};
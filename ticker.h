@@ -0,0 +1,137 @@
+//==============================================================================
+// ticker.h		A tick that is locked to the real second boundary
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// Glib::signal_timeout() just promises 'at least' the interval so the tick
+// wanders about inside the second and slides a bit later every time the main
+// loop is busy. Instead we use a Linux timerfd set with an absolute deadline
+// of the next whole second on CLOCK_REALTIME and re-arm it every time it fires
+// so it can never drift. The timerfd is just a file handle so Glib can watch
+// it like any other input.
+//
+// The same timerfd tells us if somebody moves the real clock: NTP stepping it
+// after boot, a manual date command or waking up from suspend. Armed with
+// TFD_TIMER_CANCEL_ON_SET the read fails with ECANCELED when that happens and
+// we call onJump so the owner can redo anything based on the old time.
+//
+// every(60) makes it tick on the minute instead for the low power mode.
+//
+// The JITTER block keeps a running record of how late we were so we can prove
+// the display changes when the second does.
+//
+//==============================================================================
+
+#pragma once
+
+#include <glibmm/main.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <functional>
+
+// Simple running statistics of how far past the boundary we landed
+struct JITTER {
+	int		count{0};
+	double	sum{0}, max{0}, min{1e9};	// in milliseconds
+
+	void add(double ms)
+	{
+		++count;
+		sum += ms;
+		if(ms>max) max = ms;
+		if(ms<min) min = ms;
+	}
+	double mean() const { return count ? sum/count : 0; }
+	void reset() { *this = JITTER(); }
+};
+
+class TICKER {
+protected:
+	int fd{-1};								// the timerfd
+	sigc::connection watch;					// Glib's watch on it
+	time_t deadline{0};						// the second we asked for
+	int period{1};							// seconds between ticks
+	std::function<void(const timespec&)> onTick;
+	std::function<void(const timespec&)> onJump;
+
+public:
+	TICKER() = default;
+	TICKER(const TICKER&) = delete;			// we own a file handle
+	virtual ~TICKER(){ stop(); }
+
+	// Start ticking, the callbacks get the time we actually woke up
+	void start(std::function<void(const timespec&)> tick,
+			   std::function<void(const timespec&)> jump)
+	{
+		onTick = tick;
+		onJump = jump;
+		fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+		if(fd<0){
+			perror("timerfd_create");
+			exit(1);
+		}
+		arm();
+		watch = Glib::signal_io().connect(
+					[this](Glib::IOCondition){ return fire(); },
+					fd, Glib::IO_IN, Glib::PRIORITY_HIGH);
+	}
+	// Change the tick to every 'seconds' (1 or 60) boundary
+	void every(int seconds)
+	{
+		period = seconds;
+		if(fd>=0) arm();
+	}
+	void stop()
+	{
+		watch.disconnect();
+		if(fd>=0) close(fd);
+		fd = -1;
+	}
+
+	// How late was 'now' after the second it belongs to in mS
+	static double lateness(const timespec& now)
+	{
+		return now.tv_nsec/1e6;
+	}
+
+protected:
+	// Set the timer for the next whole period of the real clock
+	void arm()
+	{
+		timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+		itimerspec its{};					// zero interval so it is one shot
+		its.it_value.tv_sec = deadline = (now.tv_sec/period + 1)*period;
+		timerfd_settime(fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+															&its, nullptr);
+	}
+
+	bool fire()
+	{
+		uint64_t expirations;				// must read it to clear the input
+		bool jumped = false;
+		if(read(fd, &expirations, sizeof(expirations))<0){
+			if(errno!=ECANCELED)
+				return true;				// spurious wake up
+			jumped = true;					// the clock was set
+		}
+
+		timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+		// a big forward step without a cancel is a belt and braces catch
+		// for sleeping through a suspend
+		if(now.tv_sec > deadline+2)
+			jumped = true;
+		arm();								// next deadline before we get busy
+		if(jumped)
+			onJump(now);
+		else
+			onTick(now);
+		return true;						// keep the watch
+	}
+};
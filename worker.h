@@ -0,0 +1,132 @@
+//==============================================================================
+// worker.h		Keep clock.py running and ask it for the calendar
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// Starting python and importing the Google libraries every hour takes the Pi
+// several seconds for a few lines of answer. Instead we start 'clock.py
+// --worker' once and it keeps its credentials and service object ready. To
+// get the calendar we write
+//		fetch\n
+// down its stdin and it answers on stdout with a line for each event and then
+// how it went and the time the fetch took
+//		event 2022-10-13T12:00:00+01:00 Lunch with Robin\n
+//		done ok 0.83\n		or	done error 0.52\n	or	done token 0.41\n
+// so there are no files to write and no chance of reading half of one. The
+// lines are picked up as they come and handed over together at the 'done'.
+// If it dies it gets started again next time. It is one of the EVENTSOURCEs
+// (see eventsource.h), the one CLOCK uses unless it is told otherwise.
+//
+//==============================================================================
+
+#pragma once
+
+#include "launcher.h"
+#include "eventsource.h"
+#include <string>
+#include <functional>
+#include <errno.h>
+
+class WORKER : public EVENTSOURCE {
+protected:
+	LAUNCHER launcher;
+	std::string errFile;					// where its stderr goes
+	sigc::connection reader, timer;
+	std::string line;						// what we have of the answer
+	CALENDAR answer;						// the events so far
+	bool	bBusy{false};					// waiting for an answer
+	bool	bWarm{false};					// it has done one before
+	std::function<void(const CALENDAR&)> onReply;
+
+public:
+	WORKER() = default;
+	WORKER(const WORKER&) = delete;
+	virtual ~WORKER(){ reader.disconnect(); timer.disconnect(); }
+
+	void setErrFile(const char* f)	{ errFile = f; }
+	bool busy() const override		{ return bBusy; }
+
+	// Ask for a fetch, done() is always called once
+	void fetch(int timeout, std::function<void(const CALENDAR&)> done) override
+	{
+		if(bBusy) return;
+		onReply = done;
+		bBusy = true;
+		answer = CALENDAR();
+		if(!launcher.running()){
+			static const char* const argv[] =
+								{ "python", "clock.py", "--worker", nullptr };
+			bWarm = false;
+			line.clear();
+			if(!launcher.start(dir.c_str(), argv, errFile.c_str(), 0,
+						[this](const RESULT& r){ died(r); }, true))
+				return;						// died() has answered already
+			reader = Glib::signal_io().connect(
+						[this](Glib::IOCondition c){ return input(c); },
+						launcher.fromChild, Glib::IO_IN | Glib::IO_HUP);
+		}
+		static const char request[] = "fetch\n";
+		if(write(launcher.toChild, request, sizeof(request)-1)<0){
+			launcher.stop();				// died() will answer
+			return;
+		}
+		timer = Glib::signal_timeout().connect_seconds(
+					[this]{ launcher.stop(); return false; }, timeout);
+	}
+
+protected:
+	void reply(const char* text)
+	{
+		timer.disconnect();
+		if(!bBusy) return;
+		bBusy = false;
+		snprintf(answer.text, sizeof(answer.text), "%s", text);
+		onReply(answer);
+	}
+
+	// Collect the answer a line at a time
+	bool input(Glib::IOCondition)
+	{
+		char buffer[256];
+		ssize_t n;
+		while((n = read(launcher.fromChild, buffer, sizeof(buffer)))>0){
+			line.append(buffer, n);
+			size_t eol;
+			while((eol = line.find('\n'))!=std::string::npos){
+				if(line.compare(0, 6, "event ")==0 && bBusy)
+					answer.lines.push_back(line.substr(6, eol-6));
+				else if(line.compare(0, 5, "done ")==0){
+					char text[80];
+					answer.ok    = line.compare(5, 2, "ok")==0;
+					answer.error = answer.ok ? CALENDAR::NONE
+								 : line.compare(5, 5, "token")==0 ? CALENDAR::AUTH
+								 : CALENDAR::NETWORK;
+					snprintf(text, sizeof(text), "clock.py %.*s (%s)",
+								int(eol-5), line.c_str()+5, bWarm ? "warm" : "cold");
+					bWarm = true;
+					reply(text);
+				}
+				line.erase(0, eol+1);
+			}
+		}
+		if(n==0 || (n<0 && errno!=EAGAIN)){	// the other end has gone
+			reader.disconnect();
+			return false;
+		}
+		return true;
+	}
+
+	// It stopped (or never started) so say so if anybody is waiting. If we
+	// killed it for taking too long it was most likely stuck on the network.
+	void died(const RESULT& r)
+	{
+		reader.disconnect();
+		char text[80];
+		r.text(text, sizeof(text), "clock.py");
+		answer.ok = false;
+		answer.error = r.bTimedOut ? CALENDAR::NETWORK : CALENDAR::WORKER;
+		reply(text);
+	}
+};
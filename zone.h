@@ -0,0 +1,390 @@
+//==============================================================================
+// zone.h		UTC to local time without calling localtime() every second
+//					part of Pi-Clock, see clock.cpp
+//==============================================================================
+//
+// spaced with tab=4
+//
+// localtime() is fine but glibc checks the TZ variable and may stat (and even
+// re-read) /etc/localtime under a lock every time it is called. Our clock
+// only needs the answer to change twice a year so ZONE reads the zone file
+// once and after that it is just sums.
+//
+// The zone file is in TZif format (man 5 tzfile): a table of the moments the
+// offset changes followed by a POSIX TZ rule string such as
+//		GMT0BST,M3.5.0/1,M10.5.0
+// for anything after the end of the table. We keep the offset that applies
+// now together with the period [from, until) it is good for so the usual
+// case is one compare, one add and turning a day number into a date.
+//
+// If the file can't be read we fall back to localtime_r() so the clock still
+// works, it just doesn't go any faster.
+//
+//==============================================================================
+
+#pragma once
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+class ZONE {
+protected:
+	struct TYPE {							// one sort of local time
+		int32_t	utoff;						// seconds east of UTC
+		bool	isdst;
+		char	abbr[8];					// "GMT", "BST"...
+	};
+	struct RULE {							// when to change from the footer
+		char	kind{0};					// 'M', 'J' or 'n' (0 for none)
+		int		month{0}, week{0}, day{0};	// as Mm.w.d or day for J and n
+		int		time{2*3600};				// seconds past local midnight
+	};
+
+	std::vector<int64_t> trans;				// UTC moments the offset changes
+	std::vector<uint8_t> index;				// the TYPE from each of them on
+	std::vector<TYPE>	 types;
+	bool	bRule{false};					// we have a footer rule
+	TYPE	stdType{}, dstType{};			// the footer's two sorts of time
+	RULE	start, end;						// DST starts and ends
+	bool	bValid{false};					// false means use localtime_r()
+
+	// what applies now and for how long
+	int64_t	from{1}, until{0};				// empty so the first call looks
+	TYPE	now{};
+
+public:
+	int		lookups{0};						// times we had to search (for -d)
+
+	ZONE(){ load(); }
+
+	// (Re)load from wherever TZ or /etc/localtime says
+	bool load()
+	{
+		const char* tz = getenv("TZ");
+		if(tz && *tz)
+			return load(tz);
+		reset();
+		return bValid = loadFile("/etc/localtime");
+	}
+
+	// Load a zone by name (Europe/London), path or rule string as TZ has them
+	bool load(const char* tz)
+	{
+		reset();
+		std::string path;
+		if(*tz==':') ++tz;
+		if(*tz!='/')
+			path = std::string("/usr/share/zoneinfo/") + tz;
+		else
+			path = tz;
+		if(loadFile(path.c_str()))
+			return bValid = true;
+		reset();							// like glibc try it as a rule
+		return bValid = bRule = parseRule(tz);
+	}
+
+	bool valid() const { return bValid; }
+
+	// The replacement for localtime_r()
+	void local(time_t utc, tm* t)
+	{
+		if(!bValid){
+			localtime_r(&utc, t);
+			return;
+		}
+		if(utc<from || utc>=until)			// crossed a change (or first go)
+			find(utc);
+
+		int64_t s = int64_t(utc) + now.utoff;
+		int64_t d = s>=0 ? s/86400 : (s-86399)/86400;	// round down
+		int secs = int(s - d*86400);
+		int y, m, md;
+		civil(d, y, m, md);
+		t->tm_year  = y - 1900;
+		t->tm_mon   = m - 1;
+		t->tm_mday  = md;
+		t->tm_hour  = secs/3600;
+		t->tm_min   = secs/60%60;
+		t->tm_sec   = secs%60;
+		t->tm_wday  = int((d%7+11)%7);		// 1970-01-01 was a Thursday
+		t->tm_yday  = int(d - days(y, 1, 1));
+		t->tm_isdst = now.isdst;
+		t->tm_gmtoff = now.utoff;
+		t->tm_zone  = now.abbr;
+	}
+
+	// Days since 1970-01-01 of a date (Howard Hinnant's algorithm)
+	static int64_t days(int y, int m, int d)
+	{
+		y -= m<=2;
+		int64_t era = (y>=0 ? y : y-399)/400;
+		int yoe = int(y - era*400);
+		int doy = (153*(m>2 ? m-3 : m+9) + 2)/5 + d-1;
+		int doe = yoe*365 + yoe/4 - yoe/100 + doy;
+		return era*146097 + doe - 719468;
+	}
+	// and back again
+	static void civil(int64_t z, int& y, int& m, int& d)
+	{
+		z += 719468;
+		int64_t era = (z>=0 ? z : z-146096)/146097;
+		int doe = int(z - era*146097);
+		int yoe = (doe - doe/1460 + doe/36524 - doe/146096)/365;
+		int doy = doe - (365*yoe + yoe/4 - yoe/100);
+		int mp = (5*doy + 2)/153;
+		d = doy - (153*mp + 2)/5 + 1;
+		m = mp<10 ? mp+3 : mp-9;
+		y = int(yoe + era*400) + (m<=2);
+	}
+
+protected:
+	// Work out the offset for utc and the period it is good for
+	void find(int64_t utc)
+	{
+		++lookups;
+		if(!trans.empty() && utc<trans.back()){
+			if(utc<trans[0]){
+				now = types[0];				// before records began
+				from = INT64_MIN;
+				until = trans[0];
+				return;
+			}
+			size_t i = std::upper_bound(trans.begin(), trans.end(), utc)
+													- trans.begin() - 1;
+			now = types[index[i]];
+			from = trans[i];
+			until = trans[i+1];
+			return;
+		}
+		int64_t after = trans.empty() ? INT64_MIN : trans.back();
+		if(!bRule){							// the table is all we have
+			now = trans.empty() ? types[0] : types[index.back()];
+			from = after;
+			until = INT64_MAX;
+			return;
+		}
+		if(!start.kind){					// no daylight saving
+			now = stdType;
+			from = after;
+			until = INT64_MAX;
+			return;
+		}
+		// Put the changes for this year and either side in order and see
+		// which pair we are between
+		int y, m, d;
+		civil((utc + stdType.utoff)/86400, y, m, d);
+		struct { int64_t when; const TYPE* type; } list[6];
+		int n = 0;
+		for(int yy=y-1; yy<=y+1; ++yy){
+			list[n++] = { when(yy, start) - stdType.utoff, &dstType };
+			list[n++] = { when(yy, end)   - dstType.utoff, &stdType };
+		}
+		std::sort(list, list+n, [](auto& a, auto& b){ return a.when<b.when; });
+		for(int i=0; i+1<n; ++i)
+			if(utc>=list[i].when && utc<list[i+1].when){
+				now = *list[i].type;
+				from = std::max(list[i].when, after);
+				until = list[i+1].when;
+				return;
+			}
+		now = stdType;						// can't get here but just in case
+		from = until = utc;
+	}
+
+	// Local seconds since 1970 of a rule's change in year y
+	static int64_t when(int y, const RULE& r)
+	{
+		int64_t d;
+		bool leap = (y%4==0 && y%100!=0) || y%400==0;
+		if(r.kind=='J')						// 1-365 ignoring 29th February
+			d = days(y, 1, 1) + r.day - 1 + (leap && r.day>=60);
+		else if(r.kind=='n')				// 0-365 counting it
+			d = days(y, 1, 1) + r.day;
+		else{								// day of week 'week' of 'month'
+			static const int mdays[] = { 31,28,31,30,31,30,31,31,30,31,30,31 };
+			int64_t first = days(y, r.month, 1);
+			int wday1 = int((first%7+11)%7);
+			int md = 1 + (r.day - wday1 + 7)%7 + (r.week-1)*7;
+			int last = mdays[r.month-1] + (leap && r.month==2);
+			while(md>last) md -= 7;			// week 5 means the last one
+			d = first + md - 1;
+		}
+		return d*86400 + r.time;
+	}
+
+	// Read a big endian number from the file's bytes
+	static int64_t be(const uint8_t* p, int n)
+	{
+		uint64_t v = 0;
+		for(int i=0; i<n; ++i)
+			v = v<<8 | p[i];
+		if(n==4) return int32_t(uint32_t(v));
+		return int64_t(v);
+	}
+
+	void reset()
+	{
+		trans.clear();
+		index.clear();
+		types.clear();
+		bRule = bValid = false;
+		from = 1;
+		until = 0;
+	}
+
+	bool loadFile(const char* path)
+	{
+		FILE* f = fopen(path, "rb");
+		if(!f) return false;
+		std::vector<uint8_t> buf;
+		uint8_t block[4096];
+		size_t n;
+		while((n = fread(block, 1, sizeof(block), f))>0)
+			buf.insert(buf.end(), block, block+n);
+		fclose(f);
+
+		// The header is 'TZif', a version, 15 spare and six counts
+		const uint8_t* p = buf.data();
+		const uint8_t* e = p + buf.size();
+		if(buf.size()<44 || memcmp(p, "TZif", 4)!=0)
+			return false;
+		bool v2 = p[4]>='2';
+		int tsize = 4;
+		if(v2){
+			// skip the old 32 bit block and use the 64 bit one after it
+			int64_t skip = 44 + be(p+32,4)*5 + be(p+36,4)*6 + be(p+40,4)
+						 + be(p+28,4)*8 + be(p+24,4) + be(p+20,4);
+			if(skip+44>int64_t(buf.size())) return false;
+			p += skip;
+			if(memcmp(p, "TZif", 4)!=0) return false;
+			tsize = 8;
+		}
+		int64_t isut = be(p+20,4), isstd = be(p+24,4), leap = be(p+28,4);
+		int64_t timecnt = be(p+32,4), typecnt = be(p+36,4), charcnt = be(p+40,4);
+		p += 44;
+		int64_t need = timecnt*(tsize+1) + typecnt*6 + charcnt
+					 + leap*(tsize+4) + isstd + isut;
+		if(typecnt<1 || p+need>e) return false;
+
+		for(int64_t i=0; i<timecnt; ++i)
+			trans.push_back(be(p + i*tsize, tsize));
+		p += timecnt*tsize;
+		for(int64_t i=0; i<timecnt; ++i)
+			index.push_back(std::min<int64_t>(p[i], typecnt-1));
+		p += timecnt;
+		const uint8_t* chars = p + typecnt*6;
+		for(int64_t i=0; i<typecnt; ++i, p+=6){
+			TYPE t{};
+			t.utoff = int32_t(be(p, 4));
+			t.isdst = p[4]!=0;
+			if(p[5]<charcnt)
+				snprintf(t.abbr, sizeof(t.abbr), "%.*s",
+							int(charcnt-p[5]), (const char*)chars+p[5]);
+			types.push_back(t);
+		}
+		p += charcnt + leap*(tsize+4) + isstd + isut;
+
+		// and the footer rule for after the table
+		if(v2 && p<e && *p=='\n'){
+			const uint8_t* q = p+1;
+			while(q<e && *q!='\n') ++q;
+			std::string rule((const char*)p+1, q-p-1);
+			if(!rule.empty())
+				bRule = parseRule(rule.c_str());
+		}
+		return true;
+	}
+
+	// POSIX TZ rule: std offset [dst [offset] [,start[/time],end[/time]]]
+	bool parseRule(const char* s)
+	{
+		stdType = dstType = TYPE{};
+		start = end = RULE{};
+		if(!name(s, stdType.abbr)) return false;
+		int off;
+		if(!hms(s, off)) return false;
+		stdType.utoff = -off;				// POSIX counts west as positive
+		if(!*s) return true;				// no summer time
+		if(!name(s, dstType.abbr)) return false;
+		dstType.isdst = true;
+		dstType.utoff = stdType.utoff + 3600;
+		if(*s && *s!=','){
+			if(!hms(s, off)) return false;
+			dstType.utoff = -off;
+		}
+		if(*s!=','){						// no rule so use the US default
+			start = { 'M', 3, 2, 0 };
+			end   = { 'M', 11, 1, 0 };
+			return true;
+		}
+		return rule(++s, start) && *s++==',' && rule(s, end);
+	}
+	static bool name(const char*& s, char* out)
+	{
+		int n = 0;
+		if(*s=='<'){						// quoted like <+03>
+			++s;
+			while(*s && *s!='>'){ if(n<7) out[n++] = *s; ++s; }
+			if(*s++!='>') return false;
+		}
+		else
+			while((*s>='A' && *s<='Z') || (*s>='a' && *s<='z')){
+				if(n<7) out[n++] = *s;
+				++s;
+			}
+		out[n] = 0;
+		return n>0;
+	}
+	static bool hms(const char*& s, int& secs)
+	{
+		int sign = 1;
+		if(*s=='+') ++s;
+		else if(*s=='-'){ sign = -1; ++s; }
+		if(*s<'0' || *s>'9') return false;
+		int part[3]{}, i = 0;
+		for(;;){
+			while(*s>='0' && *s<='9')
+				part[i] = part[i]*10 + *s++ - '0';
+			if(*s!=':' || i==2) break;
+			++s; ++i;
+		}
+		secs = sign*(part[0]*3600 + part[1]*60 + part[2]);
+		return true;
+	}
+	static bool rule(const char*& s, RULE& r)
+	{
+		auto num = [&s]{ int v = 0; while(*s>='0' && *s<='9') v = v*10 + *s++ - '0'; return v; };
+		if(*s=='M'){
+			++s;
+			r.kind = 'M';
+			r.month = num();
+			if(*s++!='.') return false;
+			r.week = num();
+			if(*s++!='.') return false;
+			r.day = num();
+			if(r.month<1 || r.month>12 || r.week<1 || r.week>5 || r.day>6)
+				return false;
+		}
+		else if(*s=='J'){
+			++s;
+			r.kind = 'J';
+			r.day = num();
+		}
+		else if(*s>='0' && *s<='9'){
+			r.kind = 'n';
+			r.day = num();
+		}
+		else
+			return false;
+		r.time = 2*3600;
+		if(*s=='/')
+			return hms(++s, r.time);
+		return true;
+	}
+};